@@ -0,0 +1,404 @@
+# Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# 1.  Redistributions of source code must retain the above copyright
+#     notice, this list of conditions and the following disclaimer.
+# 
+# 2.  Redistributions in binary form must reproduce the above copyright
+#     notice, this list of conditions and the following disclaimer in the
+#     documentation and/or other materials provided with the distribution.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+package P4::Client::ChangeFeed;
+use strict;
+use P4::Client;
+use P4::UI;
+
+
+#
+# UI class used to gather the output of "p4 changes" and "p4 describe".
+# Change numbers come from tagged or untagged output alike; describe
+# records are only available in tagged mode.
+#
+package P4::Client::ChangeFeed::UI;
+use vars qw( @ISA );
+@ISA = qw( P4::UI );
+
+sub new
+{
+	my $class = shift;
+	my $self = new P4::UI;
+	$self->{ "Changes" } = [];
+	$self->{ "Records" } = [];
+	$self->{ "Errors" } = [];
+	bless( $self, $class );
+	return $self;
+}
+
+sub OutputInfo
+{
+	my ($self, $level, $data) = @_;
+	push( @{ $self->{ "Changes" } }, $1 ) if ( $data =~ /^Change (\d+) / );
+}
+
+sub OutputStat
+{
+	my ($self, $hash) = @_;
+	push( @{ $self->{ "Changes" } }, $hash->{ "change" } );
+	push( @{ $self->{ "Records" } }, $hash );
+}
+
+sub OutputText
+{
+}
+
+sub OutputError
+{
+	my ($self, $err) = @_;
+	push( @{ $self->{ "Errors" } }, $err );
+}
+
+
+#
+# UI class for "p4 describe" which passes each record to the callback as
+# it arrives, provided it's the next change expected. After the first 
+# error or gap nothing more is passed on, so the watermark never skips
+# a change. The callback is run in an eval, as a die mustn't unwind 
+# through the API: Poll() passes it on once the command has finished.
+#
+package P4::Client::ChangeFeed::DescribeUI;
+use vars qw( @ISA );
+@ISA = qw( P4::Client::ChangeFeed::UI );
+
+sub new
+{
+	my $class = shift;
+	my $feed = shift;
+	my $callback = shift;
+	my $self = new P4::Client::ChangeFeed::UI;
+
+	$self->{ "Feed" } = $feed;
+	$self->{ "Callback" } = $callback;
+	$self->{ "Pending" } = [ @_ ];
+	$self->{ "Delivered" } = 0;
+	$self->{ "Stopped" } = 0;
+	bless( $self, $class );
+	return $self;
+}
+
+sub OutputStat
+{
+	my ($self, $hash) = @_;
+	my $pending = $self->{ "Pending" };
+
+	return if ( $self->{ "Stopped" } );
+	unless ( @$pending && $hash->{ "change" } == $pending->[ 0 ] )
+	{
+	    $self->{ "Stopped" } = 1;
+	    return;
+	}
+
+	eval { &{ $self->{ "Callback" } }( $hash ) };
+	if ( $@ )
+	{
+	    $self->{ "Died" } = $@;
+	    $self->{ "Stopped" } = 1;
+	    return;
+	}
+
+	shift( @$pending );
+	$self->{ "Feed" }->{ "Watermark" } = $hash->{ "change" };
+	$self->{ "Delivered" }++;
+}
+
+sub OutputError
+{
+	my ($self, $err) = @_;
+	$self->SUPER::OutputError( $err );
+	$self->{ "Stopped" } = 1;
+}
+
+
+package P4::Client::ChangeFeed;
+
+sub new
+{
+	my $class = shift;
+	my $client = shift;
+	my %opts = @_;
+
+	my $self = {
+		"Client"	=> $client,
+		"Path"		=> $opts{ "Path" } || "//...",
+		"StateFile"	=> $opts{ "StateFile" },
+		"Batch"		=> $opts{ "Batch" } || 50,
+		"Connections"	=> $opts{ "Connections" } || 0,
+		"Errors"	=> [],
+	};
+	bless( $self, $class );
+
+	$self->{ "Watermark" } = defined( $opts{ "Watermark" } ) ?
+					$opts{ "Watermark" } :
+					$self->_LoadWatermark();
+	return $self;
+}
+
+# Get/Set the number of the last change handed to the callback. Setting it
+# also saves it to the state file, if there is one.
+sub Watermark
+{
+	my $self = shift;
+	if ( @_ )
+	{
+	    $self->{ "Watermark" } = shift;
+	    $self->_SaveWatermark();
+	}
+	return $self->{ "Watermark" };
+}
+
+# Errors reported by the server during the last Poll()
+sub Errors
+{
+	my $self = shift;
+	return @{ $self->{ "Errors" } };
+}
+
+#
+# Fetch the changes submitted since the watermark, describe them in 
+# batches and pass each record to the callback, oldest first. Returns the
+# number of changes processed, or undef if the server reported an error.
+# If the callback dies, the watermark is saved and the error passed on.
+#
+sub Poll
+{
+	my $self = shift;
+	my $callback = shift;
+	my $client = $self->{ "Client" };
+	my $ui = new P4::Client::ChangeFeed::UI;
+	my $from = $self->{ "Watermark" } + 1;
+	my $count = 0;
+
+	$self->{ "Errors" } = [];
+	$client->Run( $ui, "changes", "-s", "submitted", 
+			$self->{ "Path" } . "\@$from,#head" );
+	return $self->_Failed( $ui ) if ( @{ $ui->{ "Errors" } } );
+
+	my @changes = sort { $a <=> $b } 
+			grep { $_ > $self->{ "Watermark" } } @{ $ui->{ "Changes" } };
+
+	while ( my @batch = splice( @changes, 0, $self->{ "Batch" } ) )
+	{
+	    my $dui = new P4::Client::ChangeFeed::DescribeUI( $self, $callback,
+							      @batch );
+	    my $conns = $self->{ "Connections" };
+
+	    if ( $conns > 0 )
+	    {
+		# Split the batch so that each connection gets a share
+		my $per = int( ( @batch + $conns - 1 ) / $conns );
+		my @jobs;
+		for ( my $i = 0; $i < @batch; $i += $per )
+		{
+		    my $last = $i + $per - 1;
+		    $last = $#batch if ( $last > $#batch );
+		    push( @jobs, [ "-s", @batch[ $i .. $last ] ] );
+		}
+		$client->RunParallel( $dui, $conns, "describe", @jobs );
+	    }
+	    else
+	    {
+		$client->Run( $dui, "describe", "-s", @batch );
+	    }
+
+	    $count += $dui->{ "Delivered" };
+	    $self->_SaveWatermark();
+	    die( $dui->{ "Died" } ) if ( defined( $dui->{ "Died" } ) );
+
+	    # Any error fails the poll, even if some records came back
+	    if ( @{ $dui->{ "Errors" } } || @{ $dui->{ "Pending" } } )
+	    {
+		push( @{ $dui->{ "Errors" } }, 
+		      "No tagged output from describe of change " .
+		      $dui->{ "Pending" }->[ 0 ] . "\n" )
+		    unless ( @{ $dui->{ "Errors" } } );
+		return $self->_Failed( $dui );
+	    }
+	}
+	return $count;
+}
+
+sub _Failed
+{
+	my $self = shift;
+	my $ui = shift;
+
+	$self->{ "Errors" } = $ui->{ "Errors" };
+	return undef;
+}
+
+sub _LoadWatermark
+{
+	my $self = shift;
+	my $file = $self->{ "StateFile" };
+	my $wm = 0;
+
+	if ( defined( $file ) && open( STATE, "<$file" ) )
+	{
+	    $wm = <STATE>;
+	    close( STATE );
+	    chomp( $wm );
+	}
+	return $wm =~ /^\d+$/ ? $wm : 0;
+}
+
+# Write to a temporary file and rename it so a crash can't leave a 
+# truncated state file behind.
+sub _SaveWatermark
+{
+	my $self = shift;
+	my $file = $self->{ "StateFile" };
+
+	return unless ( defined( $file ) );
+	open( STATE, ">$file.tmp" ) or return;
+	print( STATE $self->{ "Watermark" }, "\n" );
+	close( STATE );
+	unlink( $file ) if ( $^O eq "MSWin32" );
+	rename( "$file.tmp", $file );
+}
+
+1;
+__END__
+
+=head1 NAME
+
+P4::Client::ChangeFeed - Follow the stream of submitted changes
+
+=head1 SYNOPSIS
+
+  use P4::Client;
+  use P4::Client::ChangeFeed;
+
+  my $client = new P4::Client;
+  $client->SetProtocol( "tag", "" );
+  $client->Init() or die( "Failed to connect to Perforce Server" );
+
+  my $feed = new P4::Client::ChangeFeed( $client,
+				Path 		=> "//depot/main/...",
+				StateFile 	=> "/var/tmp/main.feed",
+				Connections 	=> 2 );
+  while ( 1 )
+  {
+      $feed->Poll( sub { my $r = shift; print( "Change $r->{change}\n" ) } )
+	  or warn( $feed->Errors() );
+      sleep( 60 );
+  }
+
+=head1 DESCRIPTION
+
+P4::Client::ChangeFeed remembers the number of the last submitted change
+it has seen (the watermark) and on each call to Poll() fetches only the
+changes submitted after it. The new changes are described in batches, 
+with several changes per "p4 describe -s" command, and optionally over 
+extra connections at once, and each describe record is passed to your 
+callback in change order. Over a single connection each record is 
+passed on as soon as it arrives; with Connections, the records of a 
+batch are only passed on once all of its describes have finished. The
+watermark can be kept in a file so that it persists from one run to 
+the next.
+
+The client must be initialised, and in tagged mode so that describe 
+records can be returned as hashes.
+
+=head1 METHODS
+
+=over 4
+
+=item C<new( $client, [ %options ] )>
+
+Construct a new feed. Options are:
+
+=over 4
+
+=item Path - the files whose changes you're interested in. Default //...
+
+=item StateFile - a file in which to keep the watermark
+
+=item Watermark - the starting watermark. Defaults to the value in 
+StateFile, or 0 meaning all changes.
+
+=item Batch - the number of changes to describe at once. Default 50.
+
+=item Connections - if set, describe each batch over this many extra
+connections at once using P4::Client::RunParallel(). The callback then
+sees each batch only once all of it has been described.
+
+=back
+
+=item C<Poll( $callback )>
+
+Fetch any changes submitted since the watermark and call $callback with
+the describe record for each one, oldest first. The watermark is advanced
+after each call and saved after each batch. Returns the number of changes
+processed, or undef if the server reported an error, in which case the
+watermark is left at the last change successfully processed. An error 
+from describe stops the poll at that change even if the records of 
+later changes came back, and is returned by Errors(). If $callback dies,
+the watermark is saved and the error passed on.
+
+=item C<Watermark( [ $change ] )>
+
+Get/Set the watermark.
+
+=item C<Errors()>
+
+Returns the errors reported during the last call to Poll().
+
+=back
+
+=head1 LICENCE
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the 
+    above copyright notice, this list of conditions 
+    and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce 
+    the above copyright notice, this list of conditions 
+    and the following disclaimer in the documentation 
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=head1 AUTHOR
+
+Tony Smith, Perforce Software ( tony@perforce.com )
+
+=head1 SEE ALSO
+
+perl(1), P4::Client(3), P4::UI(3), Perforce API documentation.
+
+=cut
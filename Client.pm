@@ -33,7 +33,7 @@ use vars qw( $VERSION @ISA @EXPORT @EXPORT_OK $AUTOLOAD );
 @EXPORT_OK = qw( );
 @EXPORT = qw( );
 
-$VERSION = '2.4319';
+$VERSION = '2.4500';
 
 bootstrap P4::Client $VERSION;
 
@@ -44,7 +44,11 @@ bootstrap P4::Client $VERSION;
 sub DebugLevel
 {
     my $self = shift;
-    $self->{ "Debug" } = shift if ( @_ );
+    if ( @_ )
+    {
+	$self->{ "Debug" } = shift;
+	$self->SetTraceLevel( "all", $self->{ "Debug" } );
+    }
     $self->{ "Debug" };
 }
 
@@ -60,6 +64,40 @@ sub DoP4Diffs
     $self->{ "PerlDiffs" } = 0;
 }
 
+# Get/Set whether tagged output is passed to OutputStat() as 
+# P4::Client::Record objects rather than hashes.
+sub LazyRecords
+{
+    my $self = shift;
+    $self->{ "LazyRecords" } = shift if ( @_ );
+    $self->{ "LazyRecords" };
+}
+
+# Get/Set how strings from the server are checked for UTF-8. The policy
+# is stored as the number of the matching Utf8Policy in utf8check.h.
+my @UTF8_POLICIES = qw( off bytes replace latin1 );
+
+sub Utf8Mode
+{
+    my $self = shift;
+    if ( @_ )
+    {
+	my $policy = shift() || "off";
+	my ( $n ) = grep { $UTF8_POLICIES[ $_ ] eq $policy } 
+			 0 .. $#UTF8_POLICIES;
+
+	if ( defined( $n ) )
+	{
+	    $self->{ "Utf8" } = $n;
+	}
+	else
+	{
+	    warn( "P4::Client - unknown UTF-8 policy '$policy'" );
+	}
+    }
+    $UTF8_POLICIES[ $self->{ "Utf8" } || 0 ];
+}
+
 
 # Change the current working directory. Returns undef on failure.
 sub SetCwd
@@ -76,6 +114,91 @@ sub SetCwd
     return $cwd;
 }
 
+# Aggregate the tagged output of subsequent commands rather than passing
+# it to OutputStat(). With no arguments, stop aggregating.
+sub SetAggregate
+{
+    my $self = shift;
+    my %spec = @_;
+    my @ops;
+
+    return $self->_SetAggregate() unless ( @_ );
+
+    foreach my $op ( qw( Sum Min Max ) )
+    {
+	next unless ( defined( $spec{ $op } ) );
+	my $fields = ref( $spec{ $op } ) ? $spec{ $op } : [ $spec{ $op } ];
+	push( @ops, lc( $op ), $_ ) foreach ( @$fields );
+    }
+
+    $self->_SetAggregate( $spec{ "Group" }, $spec{ "Depth" } || 0,
+			  $spec{ "Top" } || 0, $spec{ "By" }, @ops );
+}
+
+# Check local files against the digests reported by "p4 fstat -Ol". Takes
+# a reference to an array of fstat records and an optional hash of settings.
+# Returns a hashref containing lists of mismatched, missing and extra files.
+sub VerifyDigests
+{
+    my $self = shift;
+    my $records = shift;
+    my %opts = @_;
+
+    return $self->_VerifyDigests( $records, 
+				  $opts{ "Root" },
+				  $opts{ "Threads" } || 4,
+				  $opts{ "MmapMin" } || 1024 * 1024 );
+}
+
+# Apply a list of forms of one type, given as hashrefs. Returns a reference
+# to an array of { ok => 0|1, message => ... } in the same order.
+sub ApplyForms
+{
+    my $self = shift;
+    my $type = shift;
+    my $forms = shift;
+    my %opts = @_;
+
+    return $self->_ApplyForms( $type, $forms,
+			       $opts{ "Connections" } || 1,
+			       $opts{ "Window" } || 16 );
+}
+
+# Attach a P4::Client::HaveIndex to this client so that it's kept up to 
+# date by the sync, flush and submit commands run through it. Pass undef
+# to detach it.
+sub SetHaveIndex
+{
+    my $self = shift;
+    $self->{ "HaveIndex" } = shift;
+}
+
+# Get/Set whether Init() takes an initialised connection from the process
+# wide connection cache, and Final() gives it back, rather than connecting
+# and disconnecting. Can't be changed while the client is initialised.
+sub UseConnectionCache
+{
+    my $self = shift;
+    if ( @_ )
+    {
+	if ( $self->{ "InitCount" } )
+	{
+	    warn( "P4::Client - can't change connection caching once " .
+		  "initialized" );
+	}
+	else
+	{
+	    $self->{ "ConnCache" } = shift() ? 1 : 0;
+	}
+    }
+    $self->{ "ConnCache" };
+}
+
+# Close the cached connections when the program exits.
+END
+{
+    FlushConnectionCache();
+}
 
     
 # Makes the Perforce commands usable as methods on the object for
@@ -91,6 +214,24 @@ sub AUTOLOAD
 	return $self->Run( $ui, $cmd, @_ );
 }
 
+
+package P4::Client::HaveIndex;
+
+# (Re)build the index from the server. Options are Digests => 1 to use
+# "fstat -Ol" so that digests are stored too, and Files => [ ... ] to
+# restrict the index to some files. Returns the number of files indexed,
+# or undef if the build failed.
+sub Build
+{
+    my $self = shift;
+    my $client = shift;
+    my %opts = @_;
+
+    return $self->_Build( $client, 
+			  $opts{ "Digests" } ? 1 : 0,
+			  @{ $opts{ "Files" } || [] } );
+}
+
 1;
 __END__
 
@@ -148,16 +289,100 @@ the Run() method.
 
 Construct a new Client object. 
 
+=item C<Client::ApplyForms( $type, \@forms, [ %options ] )>
+
+Create or update a batch of forms of one type, e.g. "client" or "job",
+in one call. Each form is a hashref just as you'd pass to InputData().
+The spec is fetched from the server once and all the forms are 
+formatted in C++, then sent as "p4 $type -i" commands with several
+kept outstanding at a time rather than waiting for each reply before
+sending the next. Returns a reference to an array with one hash per 
+form, in the order given:
+
+    { ok => 1, message => "Job job000123 saved." }
+
+On failure C<ok> is 0 and C<message> holds the error. Forms which can't
+be converted fail without being sent, and without a warning; the reason
+is in their C<message>. Returns undef, with a warning, if
+the spec can't be fetched. %options may contain:
+
+=over 4
+
+=item Connections - the number of connections to spread the forms
+over. Default 1. With more than one, the forms are applied in no 
+particular order, so new jobs may not be numbered in list order.
+
+=item Window - the number of forms to keep outstanding on each 
+connection. Default 16.
+
+=back
+
+The connections are opened with the same settings as this client. The
+spec is fetched on the first of them, so no extra connection is made.
+
+=item C<Client::Collect( $cmd, [$arg...] )>
+
+Runs a command and keeps its output in a compact native store instead
+of passing it to a UI object, returning a P4::Client::Results object.
+Paths are stored with each directory held only once, and records are 
+only converted to hashes when you ask for them, so this is a much 
+cheaper way to hold on to a listing of millions of files. Use 
+SetProtocol( "tag", "" ) before Init() to get tagged output. Like Run(),
+it warns and returns undef if the client has not been initialised.
+
+=over 4
+
+=item C<$results-E<gt>Count()>
+
+The number of tagged records.
+
+=item C<$results-E<gt>Get( $index )>
+
+Returns a reference to a hash of record $index, as OutputStat() would
+have been given.
+
+=item C<$results-E<gt>Select( $field, $dir )>
+
+Returns the numbers of the records whose $field is a path somewhere
+beneath the directory $dir. e.g.
+
+    foreach my $i ( $results->Select( "depotFile", "//depot/main/src" ) )
+    {
+	print $results->Get( $i )->{ "clientFile" }, "\n";
+    }
+
+=item C<$results-E<gt>Errors()>
+
+Returns the error messages reported by the command.
+
+=back
+
 =item C<Client::Dropped()>
 
 Returns true if the TCP/IP connection between client and server has 
 been dropped.
 
+=item C<Client::FlushConnectionCache()>
+
+Closes all the idle connections in the connection cache. This is done
+for you when your program exits. See UseConnectionCache().
+
 =item C<Client::Final()>
 
 Terminate the connection and clean up. Should be called before exiting
 to cleanly disconnect.
 
+=item C<Client::GetAggregate()>
+
+Returns the table built up by the aggregation set with SetAggregate(), 
+as a reference to an array with one hash per group:
+
+    { group => "//depot/main", count => 1234, 
+      sum => { fileSize => 56789 }, max => { headTime => 1097236543 } }
+
+The groups are in descending order of count, or of the C<By> field.
+Returns undef if there's no aggregation.
+
 =item C<Client::GetClient()>
 
 Returns the current Perforce client name. This may have previously
@@ -195,6 +420,43 @@ file.
 Initializes the Perforce client and connects to the server.
 Returns false on failure and true on success.
 
+=item C<Client::ParallelSync( $ui, $threads, [$arg...] )>
+
+Sync the workspace over several connections at once. The arguments are
+the same as for "p4 sync". The list of files to be synced is fetched with
+"p4 sync -n" and divided into $threads shards of roughly equal size, each
+of which is then synced over its own connection on its own thread. The 
+new connections use the same port, user, client, host, password, working
+directory and protocol settings as this one.
+
+While the shards are running, $ui->SyncProgress() is called a few times 
+a second with the progress so far. If it dies, the shards are stopped
+after their current batch of files and the error is passed on once 
+they have. The output of each shard is passed to $ui in the usual way
+once all the shards have finished, shard by shard.
+
+Returns a hash reference containing the number of "files" and "bytes"
+actually synced, the number of "errors" reported and the number of 
+"shards". A shard whose connection is lost reports an error saying how
+many of its files weren't synced.
+
+For example:
+
+=over 4
+
+C<< $r = $client->ParallelSync( $ui, 4, "//myclient/..." ) >>
+
+=back
+
+=item C<Client::SetHaveIndex( $index )>
+
+Attach a P4::Client::HaveIndex (see below) to this client. From then on,
+the output of any "sync", "flush" or "submit" run through this client is
+used to keep the index up to date as it passes through to your P4::UI
+object. Commands run with "-n" are ignored, as are commands such as
+"edit" and "revert" which don't change the have list. Pass undef to
+detach the index.
+
 =item C<Client::Run( $ui, $cmd, [$arg...] )>
 
 Run a Perforce command. The first argument must be a reference to a 
@@ -205,6 +467,58 @@ arguments you want to pass to it. At this time, only strings and
 numbers are valid argument types although through the magic of Perl
 you can pass arrays or hashes but not references.
 
+=item C<Client::RunParallel( $ui, $connections, $cmd, \@args, [ \@args... ] )>
+
+Run the same command several times, once for each list of arguments,
+over up to $connections extra connections at once. The connections are
+opened with the same settings as this client, and each runs on its own
+thread taking the next argument list as soon as it's finished with the 
+last. The output is passed to $ui once all the commands have finished, 
+in the order of the argument lists.
+
+For example:
+
+=over 4
+
+C<< $client->RunParallel( $ui, 3, "describe", [ "-s", 101 ], [ "-s", 102 ] ) >>
+
+=back
+
+=item C<Client::SetAggregate( [ %spec ] )>
+
+Summarise the tagged output of subsequent commands rather than passing
+each record to your UI's OutputStat() method. The records are grouped
+and counted in C++, and only the table of groups is kept: see 
+GetAggregate(). The table is emptied by each call to SetAggregate(), 
+and calling it with no arguments turns aggregation off. %spec may 
+contain:
+
+=over 4
+
+=item Group - the field to group the records by. Records without it
+are ignored. With no Group, all the records are counted together.
+
+=item Depth - treat the Group field as a path and group by its first
+Depth directories. e.g. with a Depth of 2, "//depot/main/src/x.c" is 
+counted under "//depot/main".
+
+=item Sum, Min, Max - the name of a numeric field, or a reference to an
+array of them, to total or take the minimum or maximum of in each group.
+
+=item Top - return only this many groups.
+
+=item By - a Sum, Min or Max field to order the groups by. The default
+is to order them by count.
+
+=back
+
+For example, to find the ten directories using the most space:
+
+    $client->SetAggregate( Group => "depotFile", Depth => 3, 
+    			   Sum => "fileSize", By => "fileSize", Top => 10 );
+    $client->Run( $ui, "fstat", "-Ol", "//depot/..." );
+    $client->SetAggregate();
+
 =item C<Client::SetClient( $client )>
 
 Sets the name of your Perforce client. If you don't call this 
@@ -293,6 +607,28 @@ C<< print( "Debug level = ", $client->DebugLevel(), "\n" ) >>
 
 =back
 
+Debug output is only recorded if P4::Client was built with tracing
+enabled - see TRACING below. Setting the debug level sets the trace
+level of every subsystem.
+
+=item C<Client::DumpTrace()>
+
+Returns the trace events recorded so far as a string, one per line, 
+and empties the trace buffer. Returns an empty string if P4::Client 
+was built without tracing.
+
+=item C<Client::SetTraceLevel( $subsystem, $level )>
+
+Sets the trace level for one subsystem: "run", "stat", "form" or 
+"input", or "all" for every subsystem. Zero turns tracing off. Level 1
+records one event per command or callback, higher levels record more
+detail.
+
+=item C<Client::TraceOnError( $flag )>
+
+If $flag is true, the trace buffer is written to STDERR and emptied 
+whenever a command reports an error.
+
 =item C<Client::DoPerlDiffs()>
 
 Specify that you will handle the comparing of files within Perl space
@@ -324,6 +660,297 @@ C<< $client->Diff( $ui, "file.c" ) >>
 
 =back
 
+=item C<Client::LazyRecords( [flag] )>
+
+Get/Set whether the tagged output of subsequent commands is passed to
+your UI's OutputStat() method as a P4::Client::Record object rather
+than a hash reference. A record holds a compact copy of the output and
+only converts the fields you ask for into Perl data, which is much
+cheaper for wide records (e.g. "fstat -Oa") when you only look at a
+few fields. Default is off. 
+
+It has no effect if your UI object doesn't override OutputStat().
+
+=over 4
+
+=item C<$record-E<gt>Get( $key )>
+
+Returns the field as it would appear in the hash: a string, or a 
+reference to an array for numbered fields. Returns undef if there's
+no such field.
+
+=item C<$record-E<gt>Keys()>
+
+Returns the keys that the hash would have.
+
+=item C<$record-E<gt>Materialize()>
+
+Returns a reference to a hash of the whole record, exactly as 
+OutputStat() would have been given without LazyRecords(). Use this
+if you want to keep hold of the record.
+
+=back
+
+For example:
+
+    sub OutputStat
+    {
+	my ( $self, $rec ) = @_;
+	print $rec->Get( "depotFile" ), "\n";
+    }
+
+=item C<Client::UseConnectionCache( [flag] )>
+
+Get/Set whether this client shares connections with other P4::Client
+objects in the same process. When it's on, Init() takes an already
+initialised connection with the same port, user, client, host, 
+password and protocol settings from a process wide cache if there is
+one, and Final() (or destroying the object) gives it back instead of 
+disconnecting. It goes back under the settings it was taken for, even
+if you've changed them since. This saves the connect, handshake and 
+login check for programs which create many short lived clients. Must
+be called before Init(). Default is off.
+
+Connections which have been dropped are discarded rather than handed
+out. If a cached connection turns out to have been dropped by the 
+server while it was idle, read-only commands (fstat, files, changes,
+"client -o" and so on) are run again on a new connection, provided 
+they hadn't produced any output yet. If no new connection can be made,
+both errors are reported and the client is left uninitialised, as
+though Final() had been called; Init() it again to carry on.
+
+For example:
+
+    my $client = new P4::Client;
+    $client->UseConnectionCache( 1 );
+    $client->Init() or die( "Failed to connect to Perforce Server" );
+
+=item C<Client::Utf8Mode( [$policy] )>
+
+Get/Set whether strings from the server are checked for UTF-8 and 
+handed to Perl as character strings, which saves decoding every field
+with Encode when talking to a unicode server with P4CHARSET set to 
+utf8. The check applies to info and error messages, the keys and 
+values of tagged output (including P4::Client::Record and 
+P4::Client::Results objects) and the text passed to OutputText(). It's
+done in C++, and plain ASCII, which needs no flag, is skipped over 
+quickly. $policy says what to do with strings that aren't valid UTF-8:
+
+=over 4
+
+=item off - don't check anything. Every string is passed on as bytes,
+as in earlier releases. This is the default.
+
+=item bytes - pass invalid strings on as bytes, unflagged.
+
+=item replace - replace each invalid byte with U+FFFD.
+
+=item latin1 - treat each invalid byte as an ISO-8859-1 character.
+
+=back
+
+A character split between two chunks of text is put back together 
+before OutputText() sees it, and in this mode the length OutputText() 
+is given is in characters. Binary output isn't checked. The stock 
+P4::UI output methods write UTF-8 bytes, without a "Wide character" 
+warning: info, errors and text exactly as the server sent them, and 
+tagged output as $policy converted it. To a handle with a :utf8 layer
+they write characters instead.
+
+For example:
+
+    $client->Utf8Mode( "replace" );
+    $client->Run( $ui, "fstat", "//depot/..." );
+
+=item C<Client::VerifyDigests( $records, [ %options ] )>
+
+Check the files in your workspace against the digests reported by the
+server, without talking to the server. $records is a reference to an
+array of hashes as passed to P4::UI::OutputStat() by "p4 fstat -Ol". Each
+record must have a "clientFile" (or "path") and a "digest" member; records
+without both are ignored. The local files are hashed on a pool of native
+threads, and large files are memory mapped.
+
+Returns a hash reference with three members, each of which is a reference
+to an array of local paths:
+
+=over 4
+
+=item mismatch - files whose content differs from the server's
+
+=item missing - files which don't exist locally
+
+=item extra - files found under Root which weren't in $records
+
+=back
+
+The options are:
+
+=over 4
+
+=item Root - a local directory to scan for extra files. Omit it to skip
+the scan.
+
+=item Threads - the number of files to hash at once. Default 4.
+
+=item MmapMin - files at least this many bytes long are memory mapped
+rather than read. Default 1MB.
+
+=back
+
+The local bytes are compared as they are, so files which are stored 
+differently locally (ktext files, or text files with CR/LF line endings)
+will show up as mismatches.
+
+A symlink is checked by the text of its target, as Perforce stores it,
+and not by the file it points at.
+
+For example:
+
+=over 4
+
+C<< $client->Fstat( $ui, "-Ol", "//myclient/..." ) >>
+C<< $r = $client->VerifyDigests( $ui->{Records}, Root => "/ws" ) >>
+
+=back
+
+=back
+
+=head1 TRACING
+
+P4::Client can record what it's doing into a fixed size ring buffer in
+memory rather than printing it as it goes. The most recent 8192 events
+are kept, each with a timestamp. Tracing has to be compiled in:
+
+    perl Makefile.PL DEFINE=-DP4PERL_TRACE
+
+In a normal build the trace calls compile to nothing, and SetTraceLevel()
+and friends have no effect.
+
+=head1 HAVE LIST INDEX
+
+P4::Client::HaveIndex is an optional local copy of the have list, stored
+in a sorted, memory mapped file. Lookups by depot path or local path need
+no server round trip. 
+
+  my $index = new P4::Client::HaveIndex( "/ws/.p4have" );
+  $index->Build( $client, Digests => 1 ) unless ( $index->Count() );
+  $client->SetHaveIndex( $index );
+
+  $client->Sync( $ui, "//myclient/..." );	# Updates the index
+  my $rev = $index->HaveRev( "//depot/main/foo.c" );
+
+=over 4
+
+=item C<HaveIndex::new( $path )>
+
+Open the index stored in $path. If the file doesn't exist yet the index
+is empty until it's built or saved. Returns undef if the file isn't a
+valid index.
+
+=item C<HaveIndex::Build( $client, [ %options ] )>
+
+Replace the contents of the index with the have list of $client, fetched
+over a separate connection, and save it. Options are:
+
+=over 4
+
+=item Digests - use "p4 fstat -Ol" rather than "p4 have" so that file
+digests are stored too. Digests are only stored for files which you
+have at the head revision.
+
+=item Files - a reference to an array of file specifications to restrict
+the index to. The default is the whole client, "//$client/...".
+
+=back
+
+Returns the number of files in the index. If the server reports an 
+error, the error is given as a warning and undef is returned, leaving
+the index and its file as they were.
+
+=item C<HaveIndex::Lookup( $path )>
+
+Look up a file by depot path or local path. Returns a hash reference 
+containing depotFile, clientFile (the local path), haveRev and, if known,
+digest, or undef if you don't have the file. Syncing a file to a new 
+revision forgets its digest.
+
+=item C<HaveIndex::HaveRev( $path )>
+
+As Lookup(), but returns just the revision you have.
+
+=item C<HaveIndex::Count()>
+
+Returns the number of files in the index.
+
+=item C<HaveIndex::Save()>
+
+Write any changes since the index was last saved back to its file. This
+is done automatically when the index is destroyed.
+
+=item C<HaveIndex::Check( $client, [ $file... ] )>
+
+Compare the index with the server's have list by running "p4 have" on
+$client, which must already be initialised. Returns a hash reference
+containing arrays of depot paths that are "missing" from the index, 
+"stale" (a different revision) or "extra" (in the index, but not on the
+server), and a count of "errors". Extra files are only reported if no 
+file arguments are given.
+
+=back
+
+=head1 INTERNAL METHODS
+
+These methods exist so that the test suite can exercise the output
+paths without a server. They are not part of the supported interface
+and may change or disappear in any release.
+
+=over 4
+
+=item P4::Client::_Replay( $ui, $cmd, $events )
+
+Feeds a list of canned server responses through the same output
+handling as Run(), as though they had come from C<$cmd>. C<$events> is
+a reference to an array of events, each itself an array reference:
+
+  [ "stat", $var, $value, ... ]		# Tagged output
+  [ "info", $level, $text ]		# Informational message
+  [ "error", $text ]			# Failure
+  [ "text", $chunk ]			# Text output
+
+If C<$ui> is a P4::UI object, the events are delivered to it and 1 is
+returned. If C<$ui> is undef, they are collected and a
+P4::Client::Results object is returned, as from Collect().
+
+=item P4::Client::_Input( $ui, $specdef )
+
+Calls the InputData() method of C<$ui> and returns the text that would
+be sent to the server, as though the command had been given the spec
+C<$specdef>. Without C<$specdef>, hashes can't be converted to forms.
+
+=item P4::Client::_ApplyForms( $type, $forms, $connections, $window, $specdef )
+
+The implementation of ApplyForms(). If C<$specdef> is given, the forms
+are formatted against it rather than against a spec fetched from the
+server first.
+
+=item P4::Client::_PlanSync( $shards, $listing, [ $output ] )
+
+Shares out the files in C<$listing>, a list of events as for _Replay()
+standing in for the output of "p4 sync -n", between C<$shards> shards
+as ParallelSync() would. C<$output>, if given, holds a list of events 
+for each shard standing in for the output of its syncs. Returns a 
+reference to an array with a hash for each shard, holding its "files",
+their total "bytes", and how many of them ("synced") and how many bytes
+("syncedBytes") its output says were synced.
+
+=item P4::Client::_ReadOnly( $cmd, @args )
+
+Returns true if the connection cache considers C<$cmd> with C<@args>
+safe to run a second time on a fresh connection, as it does when a
+cached connection turns out to have been dropped. This is a function,
+not a method.
+
 =back
 
 =head1 API Versions
@@ -365,6 +992,6 @@ Tony Smith, Perforce Software ( tony@perforce.com )
 
 =head1 SEE ALSO
 
-perl(1), P4::UI(3), Perforce API documentation.
+perl(1), P4::UI(3), P4::Client::ChangeFeed(3), Perforce API documentation.
 
 =cut
@@ -33,6 +33,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include "clientapi.h"
+#include "spec.h"
+#include "vararray.h"
 
 /* When including Perl headers, make sure the linkage is C, not C++ */
 extern "C" 
@@ -46,7 +48,23 @@ extern "C"
 // Defined by older versions of Perl to be Perl_Error
 # undef Error
 #endif
+#include "p4trace.h"
 #include "clientuserperl.h"
+#include "p4thread.h"
+#include "digestverify.h"
+#include "p4connect.h"
+#include "clientusercollect.h"
+#include "parallelsync.h"
+#include "parallelrun.h"
+#include "haveindex.h"
+#include "strhash.h"
+#include "statrecord.h"
+#include "aggregate.h"
+#include "resultstore.h"
+#include "pathstore.h"
+#include "conncache.h"
+#include "formapply.h"
+#include "utf8check.h"
 
 /*
  * The architecture of this extension is relatively complex. The main
@@ -137,11 +155,32 @@ static int GetFlag( const char *flag, SV *obj )
 }
 
 /*
- * Local function to check if debug is enabled on a P4::Client object
+ * Local function to get hold of the trace buffer of a P4::Client object
  */
-static int DebugLevel( SV *obj )
+static P4Trace *ExtractTrace( SV *obj )
 {
-	return GetFlag( "Debug", obj );
+	SV	**tmp;
+
+	if ( ! SvROK( obj ) )
+	    return NULL;
+	tmp = hv_fetch( (HV *)SvRV(obj), "Trace", 5, 0 );
+	if ( ! tmp ) return NULL;
+	return INT2PTR( P4Trace *, SvIV( *tmp ) );
+}
+
+/*
+ * Local function to get hold of the aggregation attached to a P4::Client 
+ * object by SetAggregate(), if any
+ */
+static Aggregate *ExtractAggregate( SV *obj )
+{
+	SV	**tmp;
+
+	if ( ! SvROK( obj ) )
+	    return NULL;
+	tmp = hv_fetch( (HV *)SvRV(obj), "Aggregate", 9, 0 );
+	if ( ! tmp ) return NULL;
+	return INT2PTR( Aggregate *, SvIV( *tmp ) );
 }
 
 
@@ -153,6 +192,170 @@ static int DoPerlDiffs( SV *obj )
 	return GetFlag( "PerlDiffs", obj );
 }
 
+/*
+ * Local function to test if a P4::Client object gets its connection from
+ * the connection cache
+ */
+static int UseConnCache( SV *obj )
+{
+	return GetFlag( "ConnCache", obj );
+}
+
+/*
+ * Local function to replace the ClientApi object held by a P4::Client
+ */
+static void StoreClient( SV *obj, ClientApi *c )
+{
+	hv_store( (HV *)SvRV(obj), "Client", 6, newSViv( PTR2IV( c ) ), 0 );
+}
+
+/*
+ * Local function to test if tagged output should be passed to OutputStat()
+ * as P4::Client::Record objects
+ */
+static int LazyRecords( SV *obj )
+{
+	return GetFlag( "LazyRecords", obj );
+}
+
+/*
+ * Local function to get the Utf8Policy for strings from the server
+ */
+static int Utf8Mode( SV *obj )
+{
+	return GetFlag( "Utf8", obj );
+}
+
+
+/*
+ * Local function to take a copy of the connection settings of a 
+ * P4::Client object so that we can open more connections just like it.
+ */
+static void ExtractSettings( SV *obj, ClientApi *c, P4Settings *s )
+{
+	SV	**tmp;
+
+	s->port.Set( c->GetPort() );
+	s->user.Set( c->GetUser() );
+	s->client.Set( c->GetClient() );
+	s->host.Set( c->GetHost() );
+	s->password.Set( c->GetPassword() );
+	s->cwd.Set( c->GetCwd() );
+
+	tmp = hv_fetch( (HV *)SvRV(obj), "Protocol", 8, 0 );
+	if ( tmp && SvROK( *tmp ) )
+	{
+	    HV		*hv = (HV *)SvRV( *tmp );
+	    SV		*val;
+	    char	*key;
+	    I32		klen;
+
+	    for ( hv_iterinit( hv ); val = hv_iternextsv( hv, &key, &klen ); )
+		s->SetProtocol( key, SvPV( val, PL_na ) );
+	}
+}
+
+
+/*
+ * Local function to get the HaveIndex attached to a P4::Client object, if
+ * it should be updated by the given command. Only commands which change
+ * the have list do so; edit, revert etc. leave it alone.
+ */
+static HaveIndex *GetHaveIndex( SV *obj, const char *cmd, 
+				int argc, char **argv )
+{
+	SV	**tmp;
+
+	if ( strcmp( cmd, "sync" ) && strcmp( cmd, "flush" ) && 
+	     strcmp( cmd, "submit" ) )
+	    return NULL;
+
+	for ( int i = 0; i < argc && argv[ i ][ 0 ] == '-'; i++ )
+	    if ( ! strcmp( argv[ i ], "-n" ) )
+		return NULL;
+
+	tmp = hv_fetch( (HV *)SvRV(obj), "HaveIndex", 9, 0 );
+	if ( ! tmp || ! sv_isobject( *tmp ) || 
+		! sv_derived_from( *tmp, "P4::Client::HaveIndex" ) )
+	    return NULL;
+
+	return INT2PTR( HaveIndex *, SvIV( SvRV( *tmp ) ) );
+}
+
+/*
+ * Local function to copy a list of StrBufs into a new Perl array
+ */
+static AV *StrBufsToArray( VarArray *a )
+{
+	AV	*av = newAV();
+
+	for ( int i = 0; i < a->Count(); i++ )
+	{
+	    StrBuf *s = (StrBuf *)a->Get( i );
+	    av_push( av, newSVpv( s->Text(), s->Length() ) );
+	}
+	return av;
+}
+
+/*
+ * Local function to feed made up server output to a ClientUser, for the
+ * internal test hooks. Each event is an array ref:
+ *   [ "stat", $var, $value, ... ], [ "info", $level, $text ],
+ *   [ "error", $text ] or [ "text", $chunk ]
+ */
+static void ReplayEvents( AV *av, ClientUser *ui )
+{
+	for ( I32 i = 0; i <= av_len( av ); i++ )
+	{
+	    SV		**svp = av_fetch( av, i, 0 );
+	    AV		*ev;
+	    SV		**f[ 3 ];
+	    STRLEN	len, vlen;
+	    char	*type;
+
+	    if ( !svp || !SvROK( *svp ) || SvTYPE( SvRV( *svp ) ) != SVt_PVAV )
+		continue;
+	    ev = (AV *)SvRV( *svp );
+
+	    for ( int j = 0; j < 3; j++ )
+		f[ j ] = av_fetch( ev, j, 0 );
+	    if ( ! f[ 0 ] || ! f[ 1 ] )
+		continue;
+	    type = SvPV( *f[ 0 ], PL_na );
+
+	    if ( ! strcmp( type, "stat" ) )
+	    {
+		StrBufDict	d;
+
+		for ( I32 j = 1; j < av_len( ev ); j += 2 )
+		{
+		    char *var = SvPV( *av_fetch( ev, j, 0 ), len );
+		    char *val = SvPV( *av_fetch( ev, j + 1, 0 ), vlen );
+		    d.SetVar( StrRef( var, len ), StrRef( val, vlen ) );
+		}
+		ui->OutputStat( &d );
+	    }
+	    else if ( ! strcmp( type, "info" ) && f[ 2 ] )
+	    {
+		ui->OutputInfo( (char)( '0' + SvIV( *f[ 1 ] ) ), 
+				SvPV( *f[ 2 ], PL_na ) );
+	    }
+	    else if ( ! strcmp( type, "error" ) )
+	    {
+		Error	e;
+		char	*text = SvPV( *f[ 1 ], len );
+
+		e.Set( E_FAILED, "%text%" ) << StrRef( text, len );
+		ui->HandleError( &e );
+	    }
+	    else if ( ! strcmp( type, "text" ) )
+	    {
+		char *text = SvPV( *f[ 1 ], len );
+		ui->OutputText( text, len );
+	    }
+	}
+}
+
 
 
 MODULE = P4::Client		PACKAGE = P4::Client
@@ -197,10 +400,30 @@ new( CLASS )
 	    tmp = newSViv( 0 );
 	    hv_store( myself, "PerlDiffs", 9, tmp, 0 );
 
+	    /* Whether to use the connection cache */
+	    tmp = newSViv( 0 );
+	    hv_store( myself, "ConnCache", 9, tmp, 0 );
+
+	    /* And whether to pass tagged output as records or hashes */
+	    tmp = newSViv( 0 );
+	    hv_store( myself, "LazyRecords", 11, tmp, 0 );
+
+	    /* And the Utf8Policy for strings from the server */
+	    tmp = newSViv( 0 );
+	    hv_store( myself, "Utf8", 4, tmp, 0 );
+
 	    /* Now add the debug flag */
 	    tmp = newSViv( 0 );
 	    hv_store( myself, "Debug", 5, tmp, 0 );
 
+	    /* The trace buffer. Does nothing unless built with P4PERL_TRACE */
+	    tmp = newSViv( PTR2IV( new P4Trace ) );
+	    hv_store( myself, "Trace", 5, tmp, 0 );
+
+	    /* And somewhere to remember the protocol settings */
+	    tmp = newRV_noinc( (SV *)newHV() );
+	    hv_store( myself, "Protocol", 8, tmp, 0 );
+
 	    /* Return a blessed reference to the hash */
 	    RETVAL = newRV_noinc( (SV * )myself );
 	    stash = gv_stashpv( CLASS, TRUE );
@@ -222,13 +445,56 @@ DESTROY( THIS )
 	    if ( ! ExtractData( THIS, &e, &c, &count ) )
 		XSRETURN_UNDEF;
 	
-	    if ( SvIV( count ) )
+	    // A connection from the cache goes back to it, not away
+	    if ( SvIV( count ) && ConnCache::Release( c ) )
+		c = 0;
+	    else if ( SvIV( count ) )
 		c->Final( e );
 	
+	    delete ExtractTrace( THIS );
+	    delete ExtractAggregate( THIS );
 	    delete e;
 	    delete c;
 	    
 
+ClientUserCollect *
+Collect( THIS, cmd, ... )
+	SV	*THIS
+	char	*cmd
+
+	INIT:
+	    ClientApi	*c;
+	    Error	*e;
+	    SV		*count;
+	    I32		va_start = 2;
+	    char	**args = NULL;
+
+	CODE:
+	    if ( ! ExtractData( THIS, &e, &c, &count ) )
+	       	XSRETURN_UNDEF;
+
+	    if ( ! SvIV( count ) )
+	    {
+		warn( "P4::Client::Collect() - Client has not been initialised" );
+		XSRETURN_UNDEF;
+	    }
+
+	    if ( items > va_start )
+	    {
+		New( 0, args, items - va_start, char * );
+		for ( I32 i = va_start; i < items; i++ )
+		    args[ i - va_start ] = SvPV( ST( i ), PL_na );
+	    }
+
+	    RETVAL = new ClientUserCollect;
+	    RETVAL->SetUtf8( Utf8Mode( THIS ) );
+	    c->SetArgv( items - va_start, args );
+	    c->Run( cmd, RETVAL );
+	    if ( args ) Safefree( args );
+
+	OUTPUT:
+	    RETVAL
+
 int
 Dropped( THIS )
 	SV	*THIS
@@ -236,7 +502,7 @@ Dropped( THIS )
 	    ClientApi	*c;
 	CODE:
 	    c = ExtractClient( THIS );
-	    if ( c ) XSRETURN_UNDEF;
+	    if ( ! c ) XSRETURN_UNDEF;
 	    RETVAL = c->Dropped();
 	OUTPUT:
 	    RETVAL
@@ -256,7 +522,24 @@ Final( THIS )
 
 	    if ( SvIV( count ) )
 	    {
-	        c->Final( e );
+		P4Settings	settings;
+
+		/*
+		 * A connection from the cache goes back to it, under the 
+		 * settings it was made for. Keep our current settings in a
+		 * fresh ClientApi in case we're Init()ed again
+		 */
+		ExtractSettings( THIS, c, &settings );
+		if ( ConnCache::Release( c ) )
+		{
+		    c = new ClientApi;
+		    settings.Apply( c );
+		    StoreClient( THIS, c );
+		}
+		else
+		{
+		    c->Final( e );
+		}
 		sv_setiv( count, SvIV(count) - 1 );
 	    }
 	    else
@@ -264,6 +547,66 @@ Final( THIS )
 		warn( "Can't call Final() when you haven't called Init()" );
 	    }
 
+void
+FlushConnectionCache()
+
+	CODE:
+	    ConnCache::Flush();
+
+SV *
+GetAggregate( THIS )
+	SV	*THIS
+
+	INIT:
+	    Aggregate	*a;
+	    AV		*av;
+	    HV		*ops[ 3 ];
+	    int		utf8 = Utf8Mode( THIS );
+	    double	v;
+	    static const char *opNames[] = { "sum", "min", "max" };
+
+	CODE:
+	    if ( ! ( a = ExtractAggregate( THIS ) ) )
+		XSRETURN_UNDEF;
+
+	    /*
+	     * Returns an array of hashes, one per group, in order:
+	     *   { group => ..., count => ..., sum => { field => ... }, ... }
+	     */
+	    av = newAV();
+	    for ( int i = 0; i < a->Count(); i++ )
+	    {
+		HV	*hv = newHV();
+		const StrPtr *g = a->Group( i );
+
+		hv_store( hv, "group", 5, 
+			  ClientUserPerl::NewString( g->Text(), g->Length(), 
+			  			     utf8 ), 0 );
+		hv_store( hv, "count", 5, newSViv( a->GroupCount( i ) ), 0 );
+
+		ops[ AG_SUM ] = ops[ AG_MIN ] = ops[ AG_MAX ] = 0;
+		for ( int j = 0; j < a->Ops(); j++ )
+		{
+		    int		t = a->OpType( j );
+		    const StrPtr *f = a->OpField( j );
+
+		    if ( ! ops[ t ] )
+		    {
+			ops[ t ] = newHV();
+			hv_store( hv, opNames[ t ], 3, 
+				  newRV_noinc( (SV *)ops[ t ] ), 0 );
+		    }
+		    if ( a->Value( i, j, v ) )
+			hv_store( ops[ t ], f->Text(), f->Length(), 
+				  newSVnv( v ), 0 );
+		}
+		av_push( av, newRV_noinc( (SV *)hv ) );
+	    }
+	    RETVAL = newRV_noinc( (SV *)av );
+
+	OUTPUT:
+	    RETVAL
+
 SV *
 GetClient( THIS )
 	SV 	*THIS
@@ -381,7 +724,23 @@ Init( THIS )
 	    }
 
 	    e->Clear();
-	    c->Init( e );
+	    if ( UseConnCache( THIS ) )
+	    {
+		P4Settings	settings;
+		ClientApi	*cached;
+
+		ExtractSettings( THIS, c, &settings );
+		if ( ( cached = ConnCache::Get( &settings, e ) ) )
+		{
+		    delete c;
+		    StoreClient( THIS, cached );
+		}
+	    }
+	    else
+	    {
+		c->Init( e );
+	    }
+
 	    RETVAL = newSViv( ! e->Test() );
 	    if ( ! e->Test() )
 		sv_setiv( count, SvIV( count ) + 1 );
@@ -389,6 +748,129 @@ Init( THIS )
 	OUTPUT:
 	    RETVAL
 
+SV *
+DumpTrace( THIS )
+	SV	*THIS
+
+	INIT:
+	    P4Trace	*trace;
+	    StrBuf	dump;
+
+	CODE:
+	    if ( ! ( trace = ExtractTrace( THIS ) ) )
+		XSRETURN_UNDEF;
+
+	    trace->Dump( dump );
+	    trace->Clear();
+	    RETVAL = newSVpv( dump.Text(), dump.Length() );
+
+	OUTPUT:
+	    RETVAL
+
+SV *
+ParallelSync( THIS, uiref, threads, ... )
+	SV	*THIS
+	SV	*uiref
+	int	threads
+	INIT:
+	    ClientApi		*c;
+	    ClientUserPerl	*ui;
+	    P4Settings		settings;
+	    ParallelSync	*ps;
+	    I32			va_start = 3;
+	    I32			argc = 0;
+	    char		**args = NULL;
+	    int			files;
+	    double		bytes;
+	    int			died = 0;
+	    HV			*result;
+
+	CODE:
+	    c = ExtractClient( THIS );
+	    if ( ! c )
+	       	XSRETURN_UNDEF;
+
+	    if ( !( sv_isobject(uiref) && sv_derived_from( uiref, "P4::UI") ) )
+	    {
+		warn("P4::Client::ParallelSync() - uiref is not a P4::UI object");
+		XSRETURN_UNDEF;
+	    }
+
+	    ExtractSettings( THIS, c, &settings );
+
+	    if ( items > va_start )
+	    {
+		argc = items - va_start;
+		New( 0, args, argc, char * );
+		for ( I32 i = 0; i < argc; i++ )
+		    args[ i ] = SvPV( ST( va_start + i ), PL_na );
+	    }
+
+	    ui = new ClientUserPerl( uiref );
+	    ui->SetTrace( ExtractTrace( THIS ) );
+	    ui->LazyRecords( LazyRecords( THIS ) );
+	    ui->Utf8Mode( Utf8Mode( THIS ) );
+	    ui->SetAggregate( ExtractAggregate( THIS ) );
+	    ps = new ParallelSync( &settings, threads );
+
+	    /*
+	     * Fetch the file list, and start the shards syncing. The workers
+	     * don't touch Perl, so while they're running we're free to
+	     * report progress to the UI.
+	     */
+	    ps->List( argc, args );
+	    ps->Listing()->Replay( ui, CT_MASK( CT_ERROR ) );
+	    ps->Start();
+
+	    /*
+	     * If SyncProgress() dies, the threads still have our settings
+	     * and ps, so stop them and clean up before passing the error on.
+	     */
+	    while ( ! ps->Poll( files, bytes ) )
+	    {
+		if ( ! ui->SyncProgress( files, ps->TotalFiles(), 
+					 bytes, ps->TotalBytes() ) )
+		{
+		    died = 1;
+		    ps->Cancel();
+		    break;
+		}
+		P4Sleep( 250 );
+	    }
+	    ps->Wait();
+	    ps->Poll( files, bytes );
+	    if ( ! died && ! ui->SyncProgress( files, ps->TotalFiles(), 
+					       bytes, ps->TotalBytes() ) )
+		died = 1;
+
+	    if ( died )
+	    {
+		SV	*err = sv_2mortal( newSVsv( ERRSV ) );
+
+		delete ps;
+		delete ui;
+		if ( args ) Safefree( args );
+		sv_setsv( ERRSV, err );
+		croak( Nullch );
+	    }
+
+	    for ( int i = 0; i < ps->Shards(); i++ )
+		ps->Output( i )->Replay( ui );
+
+	    result = newHV();
+	    hv_store( result, "files", 5, newSViv( files ), 0 );
+	    hv_store( result, "bytes", 5, newSVnv( bytes ), 0 );
+	    hv_store( result, "errors", 6, newSViv( ps->Errors() ), 0 );
+	    hv_store( result, "shards", 6, newSViv( ps->Shards() ), 0 );
+	    RETVAL = newRV_noinc( (SV *)result );
+
+	    delete ps;
+	    delete ui;
+	    if ( args ) Safefree( args );
+
+	OUTPUT:
+	    RETVAL
+
 void
 Run( THIS, uiref, cmd, ... )
 	SV *THIS
@@ -401,7 +883,6 @@ Run( THIS, uiref, cmd, ... )
 
 	    AV		*args;
 	    I32		va_start = 3;
-	    I32		debug = 0;
 	    I32		argc;
 	    I32		stindex;
 	    I32		argindex;
@@ -410,10 +891,9 @@ Run( THIS, uiref, cmd, ... )
 	    char		**cmdargs = NULL;
 	    SV		*sv;
 	    ClientUserPerl	*ui = NULL;
+	    P4Trace	*trace;
 
 	CODE:
-	    debug = DebugLevel( THIS );
-
 	    if ( ! ExtractData( THIS, &e, &c, &count ) )
 	    {
 		warn("Not a P4::Client object" );
@@ -441,13 +921,15 @@ Run( THIS, uiref, cmd, ... )
 		XSRETURN_UNDEF;
 	    };
 	
-	    ui->DebugLevel( debug );
+	    trace = ExtractTrace( THIS );
+	    ui->SetTrace( trace );
 	    ui->DoPerlDiffs( DoPerlDiffs( THIS ) );
+	    ui->LazyRecords( LazyRecords( THIS ) );
+	    ui->Utf8Mode( Utf8Mode( THIS ) );
+	    ui->SetAggregate( ExtractAggregate( THIS ) );
 
-	    if ( debug )
-		printf( "[P4::Client::Run] Running a \"p4 %s\" with %d args\n", 
-			SvPV( cmd, PL_na ),
-			items - va_start );
+	    P4TRACE( trace, TR_RUN, 1, "Run", SvPV( cmd, PL_na ), 
+	    		items - va_start );
 
 	    if ( items > va_start )
 	    {
@@ -461,8 +943,6 @@ Run( THIS, uiref, cmd, ... )
 		    {
 			currarg = SvPV( ST(stindex), len );
 			cmdargs[argindex] =  currarg ;
-			if ( debug )
-			    printf( "\tArg[ %d ] = %s\n", argindex, currarg );
 		    }
 		    else if ( SvIOK( ST(stindex) ) )
 		    {
@@ -477,8 +957,6 @@ Run( THIS, uiref, cmd, ... )
 			sv = sv_2mortal(newSVpv( buf, 0 ));
 			currarg = SvPV( sv, len );
 			cmdargs[argindex] = currarg;
-			if ( debug )
-			    printf( "\tArg[ %d ] = %s\n", argindex, currarg );
 		    }
 		    else
 		    {
@@ -494,64 +972,318 @@ Run( THIS, uiref, cmd, ... )
 
 	    len = 0;
 	    currarg = SvPV( cmd, len );
-	    if ( debug )
+	    for ( int i = 0; i < items - va_start; i++ )
+		P4TRACE( trace, TR_RUN, 2, "arg", cmdargs[ i ], i );
+	    ui->SetHaveIndex( GetHaveIndex( THIS, currarg, items - va_start, 
+	    				    cmdargs ), currarg );
+	    if ( UseConnCache( THIS ) && SvIV( count ) )
+	    {
+		P4Settings	settings;
+
+		/*
+		 * If the connection was lost for good, the cache has closed
+		 * it already. Leave a fresh ClientApi with the same settings
+		 * in its place, uninitialised, as Final() would have.
+		 */
+		if ( ! ConnCache::Run( c, currarg, items - va_start, cmdargs, 
+				       ui, e ) )
+		{
+		    ExtractSettings( THIS, c, &settings );
+		    delete c;
+		    c = new ClientApi;
+		    settings.Apply( c );
+		    StoreClient( THIS, c );
+		    sv_setiv( count, 0 );
+		}
+	    }
+	    else
 	    {
-	        for ( int i = 0; i < items - va_start; i++ )
-	        {
-		    printf("[P4::Client::Run] Arg[%d] = %s\n", i, cmdargs[i] );
-	        }
+		c->SetArgv( items - va_start, cmdargs );
+		c->Run( currarg, ui );
 	    }
-	    c->SetArgv( items - va_start, cmdargs );
-	    c->Run( currarg, ui );
 	    if ( ui )delete ui;
 	    if ( cmdargs )Safefree( cmdargs );
 
 void
-SetClient( THIS, clientName )
+RunParallel( THIS, uiref, threads, cmd, ... )
 	SV	*THIS
-	char 	*clientName
-
+	SV	*uiref
+	int	threads
+	char	*cmd
 	INIT:
-	    ClientApi	*c;
+	    ClientApi		*c;
+	    ClientUserPerl	*ui;
+	    P4Settings		settings;
+	    ParallelRun		*pr;
+	    I32			va_start = 4;
+	    char		**args;
 
 	CODE:
 	    c = ExtractClient( THIS );
 	    if ( ! c )
 	       	XSRETURN_UNDEF;
 
-	    c->SetClient( clientName );
+	    if ( !( sv_isobject(uiref) && sv_derived_from( uiref, "P4::UI") ) )
+	    {
+		warn("P4::Client::RunParallel() - uiref is not a P4::UI object");
+		XSRETURN_UNDEF;
+	    }
 
+	    /*
+	     * Each remaining argument is a reference to the argument list
+	     * for one run of the command.
+	     */
+	    ExtractSettings( THIS, c, &settings );
+	    pr = new ParallelRun( &settings, threads );
 
-void
-_SetCwd( THIS, cwd )
-	SV	*THIS
-	char *cwd
+	    for ( I32 i = va_start; i < items; i++ )
+	    {
+		AV	*av;
+		I32	argc;
 
-	INIT:
-	    ClientApi	*c;
+		if ( ! SvROK( ST( i ) ) || SvTYPE( SvRV( ST( i ) ) ) != SVt_PVAV )
+		{
+		    delete pr;
+		    croak( "P4::Client::RunParallel() - arguments must be array references" );
+		}
 
-	CODE:
-	    c = ExtractClient( THIS );
-	    if ( ! c )
-	       	XSRETURN_UNDEF;
-	
-	    c->SetCwd( cwd );
+		av = (AV *)SvRV( ST( i ) );
+		argc = av_len( av ) + 1;
+		New( 0, args, argc + 1, char * );
+		for ( I32 a = 0; a < argc; a++ )
+		{
+		    SV **svp = av_fetch( av, a, 0 );
+		    args[ a ] = svp ? SvPV( *svp, PL_na ) : (char *)"";
+		}
+		pr->Add( cmd, argc, args );
+		Safefree( args );
+	    }
 
+	    pr->Run();
 
-void
-SetHost( THIS, hostname )
-	SV	*THIS
-	char *hostname
+	    ui = new ClientUserPerl( uiref );
+	    ui->SetTrace( ExtractTrace( THIS ) );
+	    ui->LazyRecords( LazyRecords( THIS ) );
+	    ui->Utf8Mode( Utf8Mode( THIS ) );
+	    ui->SetAggregate( ExtractAggregate( THIS ) );
+	    for ( int j = 0; j < pr->Jobs(); j++ )
+		pr->Output( j )->Replay( ui );
 
+	    delete ui;
+	    delete pr;
+
+SV *
+_ApplyForms( THIS, type, formsref, connections, window, given = NULL )
+	SV	*THIS
+	char	*type
+	SV	*formsref
+	int	connections
+	int	window
+	char	*given
 	INIT:
-	    ClientApi	*c;
+	    ClientApi		*c;
+	    P4Trace		*trace;
+	    P4Settings		settings;
+	    FormApply		*fa;
+	    Spec		*spec;
+	    StrBuf		specdef;
+	    Error		e;
+	    AV			*forms;
+	    AV			*av;
+	    int			utf8 = Utf8Mode( THIS );
 
 	CODE:
 	    c = ExtractClient( THIS );
 	    if ( ! c )
 	       	XSRETURN_UNDEF;
 
-	    c->SetHost( hostname );
+	    if ( !SvROK( formsref ) || SvTYPE( SvRV( formsref ) ) != SVt_PVAV )
+	    {
+		warn( "P4::Client::ApplyForms() - forms must be an array reference" );
+		XSRETURN_UNDEF;
+	    }
+	    forms = (AV *)SvRV( formsref );
+	    trace = ExtractTrace( THIS );
+
+	    /*
+	     * Fetch the spec once and format every form against it here, on
+	     * the Perl thread. Forms which can't be formatted keep their 
+	     * place in the results but are never sent.
+	     */
+	    ExtractSettings( THIS, c, &settings );
+	    fa = new FormApply( &settings, type, connections, window );
+
+	    if ( given )
+		specdef.Set( given );
+	    else if ( ! fa->GetSpecDef( specdef, &e ) )
+	    {
+		StrBuf	msg;
+		e.Fmt( &msg );
+		delete fa;
+		warn( "P4::Client::ApplyForms() - %s", msg.Text() );
+		XSRETURN_UNDEF;
+	    }
+
+	    P4TRACE( trace, TR_FORM, 1, "ApplyForms", type, av_len( forms ) + 1 );
+
+	    spec = new Spec( specdef.Text(), "" );
+	    for ( I32 i = 0; i <= av_len( forms ); i++ )
+	    {
+		SV	**svp = av_fetch( forms, i, 0 );
+		StrBuf	form, err;
+
+		if ( !svp || !SvROK( *svp ) || SvTYPE( SvRV( *svp ) ) != SVt_PVHV )
+		    fa->AddFailed( "Not a hash reference." );
+		else if ( !ClientUserPerl::HashToForm( (HV *)SvRV( *svp ), spec,
+						    &form, trace, &err ) )
+		    fa->AddFailed( err.Text() );
+		else
+		    fa->Add( form );
+	    }
+	    delete spec;
+
+	    fa->Run();
+
+	    /*
+	     * One hash per form, in the order given:
+	     *   { ok => 0|1, message => ... }
+	     * The message is the server's reply, or the error if it failed.
+	     */
+	    av = newAV();
+	    for ( int j = 0; j < fa->Forms(); j++ )
+	    {
+		ClientUserCollect *o = fa->Output( j );
+		HV	*hv = newHV();
+		int	ok = !o->Errors();
+		StrBuf	msg;
+
+		for ( int k = 0; k < o->Count(); k++ )
+		{
+		    int	t = o->Type( k );
+		    if ( ok ? t != CT_INFO : 
+			      t != CT_ERROR || o->Level( k ) < E_FAILED )
+			continue;
+		    if ( msg.Length() && msg[ msg.Length() - 1 ] != '\n' )
+			msg.Append( "\n" );
+		    msg.Append( o->Text( k ) );
+		}
+		while ( msg.Length() && msg[ msg.Length() - 1 ] == '\n' )
+		    msg.SetLength( msg.Length() - 1 );
+
+		hv_store( hv, "ok", 2, newSViv( ok ), 0 );
+		hv_store( hv, "message", 7, 
+			  ClientUserPerl::NewString( msg.Text(), msg.Length(),
+						     utf8 ), 0 );
+		av_push( av, newRV_noinc( (SV *)hv ) );
+	    }
+	    delete fa;
+	    RETVAL = newRV_noinc( (SV *)av );
+
+	OUTPUT:
+	    RETVAL
+
+void
+_SetAggregate( THIS, ... )
+	SV	*THIS
+
+	INIT:
+	    Aggregate	*a;
+	    int		by = -1;
+	    I32		va_start = 5;
+
+	CODE:
+	    if ( ! SvROK( THIS ) )
+		XSRETURN_UNDEF;
+
+	    delete ExtractAggregate( THIS );
+	    hv_delete( (HV *)SvRV( THIS ), "Aggregate", 9, G_DISCARD );
+
+	    /* 
+	     * Called with no spec to stop aggregating. Otherwise the args
+	     * are group, depth, top, by, and then pairs of op and field.
+	     */
+	    if ( items < va_start )
+		XSRETURN_UNDEF;
+
+	    a = new Aggregate;
+	    a->SetGroup( SvOK( ST(1) ) ? SvPV( ST(1), PL_na ) : 0, SvIV( ST(2) ) );
+
+	    for ( I32 i = va_start; i + 1 < items; i += 2 )
+	    {
+		const char *op = SvPV( ST(i), PL_na );
+		const char *field = SvPV( ST(i + 1), PL_na );
+		int	j = -1;
+
+		if ( ! strcmp( op, "sum" ) )
+		    j = a->AddOp( AG_SUM, field );
+		else if ( ! strcmp( op, "min" ) )
+		    j = a->AddOp( AG_MIN, field );
+		else if ( ! strcmp( op, "max" ) )
+		    j = a->AddOp( AG_MAX, field );
+		else
+		{
+		    warn( "P4::Client::SetAggregate() - unknown operation" );
+		    continue;
+		}
+
+		if ( j < 0 )
+		    warn( "P4::Client::SetAggregate() - too many operations" );
+
+		if ( j >= 0 && by < 0 && SvOK( ST(4) ) &&
+		     ! strcmp( field, SvPV( ST(4), PL_na ) ) )
+		    by = j;
+	    }
+	    a->SetTop( SvIV( ST(3) ), by );
+
+	    hv_store( (HV *)SvRV( THIS ), "Aggregate", 9, 
+	    	      newSViv( PTR2IV( a ) ), 0 );
+
+void
+SetClient( THIS, clientName )
+	SV	*THIS
+	char 	*clientName
+
+	INIT:
+	    ClientApi	*c;
+
+	CODE:
+	    c = ExtractClient( THIS );
+	    if ( ! c )
+	       	XSRETURN_UNDEF;
+
+	    c->SetClient( clientName );
+
+
+void
+_SetCwd( THIS, cwd )
+	SV	*THIS
+	char *cwd
+
+	INIT:
+	    ClientApi	*c;
+
+	CODE:
+	    c = ExtractClient( THIS );
+	    if ( ! c )
+	       	XSRETURN_UNDEF;
+	
+	    c->SetCwd( cwd );
+
+
+void
+SetHost( THIS, hostname )
+	SV	*THIS
+	char *hostname
+
+	INIT:
+	    ClientApi	*c;
+
+	CODE:
+	    c = ExtractClient( THIS );
+	    if ( ! c )
+	       	XSRETURN_UNDEF;
+
+	    c->SetHost( hostname );
 
 void
 SetPassword( THIS, password )
@@ -592,6 +1324,7 @@ SetProtocol( THIS, protocol, value )
 
 	INIT:
 	    ClientApi	*c;
+	    SV		**tmp;
 	
 	CODE:
 	    c = ExtractClient( THIS );
@@ -600,6 +1333,33 @@ SetProtocol( THIS, protocol, value )
 
 	    c->SetProtocol( protocol, value );
 
+	    /* Remember it for any extra connections we make */
+	    tmp = hv_fetch( (HV *)SvRV(THIS), "Protocol", 8, 0 );
+	    if ( tmp && SvROK( *tmp ) )
+		hv_store( (HV *)SvRV( *tmp ), protocol, strlen( protocol ),
+			newSVpv( value, 0 ), 0 );
+
+void
+SetTraceLevel( THIS, subsys, level )
+	SV	*THIS
+	char	*subsys
+	int	level
+
+	INIT:
+	    P4Trace	*trace;
+	    int		s;
+
+	CODE:
+	    if ( ! ( trace = ExtractTrace( THIS ) ) )
+		XSRETURN_UNDEF;
+
+	    if ( ( s = P4Trace::Subsystem( subsys ) ) < -1 )
+	    {
+		warn( "P4::Client::SetTraceLevel() - unknown subsystem" );
+		XSRETURN_UNDEF;
+	    }
+	    trace->SetLevel( s, level );
+
 void
 SetUser( THIS, username )
 	SV	*THIS
@@ -615,3 +1375,714 @@ SetUser( THIS, username )
 
 	    c->SetUser( username );
 
+void
+TraceOnError( THIS, flag )
+	SV	*THIS
+	int	flag
+
+	INIT:
+	    P4Trace	*trace;
+
+	CODE:
+	    if ( ! ( trace = ExtractTrace( THIS ) ) )
+		XSRETURN_UNDEF;
+	    trace->SetDumpOnError( flag );
+
+SV *
+_VerifyDigests( THIS, records, root, threads, mmapmin )
+	SV	*THIS
+	SV	*records
+	SV	*root
+	int	threads
+	int	mmapmin
+
+	INIT:
+	    DigestVerify	dv;
+	    AV			*av;
+	    HV			*result;
+	    AV			*mismatch;
+	    AV			*missing;
+	    AV			*extra;
+	    SV			**svp;
+	    I32			i;
+
+	CODE:
+	    if ( ! SvROK( records ) || SvTYPE( SvRV( records ) ) != SVt_PVAV )
+	    {
+		warn( "P4::Client::VerifyDigests() - expected an array reference" );
+		XSRETURN_UNDEF;
+	    }
+
+	    /*
+	     * Pull the paths and digests out of the records while we're
+	     * still on the Perl thread. Records without a digest (deleted
+	     * at head, or never synced) can't be checked so we skip them.
+	     */
+	    av = (AV *)SvRV( records );
+	    for ( i = 0; i <= av_len( av ); i++ )
+	    {
+		SV	**path;
+		SV	**digest;
+		HV	*rec;
+
+		svp = av_fetch( av, i, 0 );
+		if ( ! svp || ! SvROK( *svp ) || 
+			SvTYPE( SvRV( *svp ) ) != SVt_PVHV )
+		    continue;
+
+		rec = (HV *)SvRV( *svp );
+		path = hv_fetch( rec, "clientFile", 10, 0 );
+		if ( ! path ) path = hv_fetch( rec, "path", 4, 0 );
+		digest = hv_fetch( rec, "digest", 6, 0 );
+
+		if ( ! path || ! digest || ! SvOK( *path ) || ! SvOK( *digest ) )
+		    continue;
+
+		dv.Add( SvPV( *path, PL_na ), SvPV( *digest, PL_na ) );
+	    }
+
+	    dv.SetThreads( threads );
+	    dv.SetMmapMin( mmapmin );
+	    dv.Verify();
+
+	    if ( SvOK( root ) )
+		dv.FindExtras( SvPV( root, PL_na ) );
+
+	    result = newHV();
+	    mismatch = newAV();
+	    missing = newAV();
+	    extra = newAV();
+
+	    for ( i = 0; i < dv.Count(); i++ )
+	    {
+		const StrPtr *p = dv.Path( i );
+
+		if ( dv.Status( i ) == DV_MISMATCH )
+		    av_push( mismatch, newSVpv( p->Text(), p->Length() ) );
+		else if ( dv.Status( i ) == DV_MISSING )
+		    av_push( missing, newSVpv( p->Text(), p->Length() ) );
+	    }
+
+	    for ( i = 0; i < dv.ExtraCount(); i++ )
+	    {
+		const StrPtr *p = dv.Extra( i );
+		av_push( extra, newSVpv( p->Text(), p->Length() ) );
+	    }
+
+	    hv_store( result, "mismatch", 8, newRV_noinc( (SV *)mismatch ), 0 );
+	    hv_store( result, "missing", 7, newRV_noinc( (SV *)missing ), 0 );
+	    hv_store( result, "extra", 5, newRV_noinc( (SV *)extra ), 0 );
+	    RETVAL = newRV_noinc( (SV *)result );
+
+	OUTPUT:
+	    RETVAL
+
+int
+_ReadOnly( cmd, ... )
+	char	*cmd
+
+	INIT:
+	    I32		va_start = 1;
+	    char	**args = NULL;
+
+	CODE:
+	    /*
+	     * Used by the tests: whether the connection cache counts the
+	     * command as safe to run again.
+	     */
+	    if ( items > va_start )
+	    {
+		New( 0, args, items - va_start, char * );
+		for ( I32 i = va_start; i < items; i++ )
+		    args[ i - va_start ] = SvPV( ST( i ), PL_na );
+	    }
+	    RETVAL = ConnCache::ReadOnly( cmd, items - va_start, args );
+	    if ( args ) Safefree( args );
+
+	OUTPUT:
+	    RETVAL
+
+SV *
+_Replay( THIS, uiref, cmd, events )
+	SV	*THIS
+	SV	*uiref
+	char	*cmd
+	SV	*events
+
+	INIT:
+	    ClientUser		*ui;
+	    ClientUserPerl	*cup = 0;
+	    ClientUserCollect	*collect = 0;
+	    AV			*av;
+
+	CODE:
+	    /*
+	     * Used by the tests. Feeds made up server output to the 
+	     * ClientUser that Run() would use, or with no UI the one 
+	     * Collect() would, so output handling can be tested without a 
+	     * server. Returns true, or the P4::Client::Results for Collect().
+	     */
+	    if ( !SvROK( events ) || SvTYPE( SvRV( events ) ) != SVt_PVAV )
+	    {
+		warn( "P4::Client::_Replay() - events must be an array reference" );
+		XSRETURN_UNDEF;
+	    }
+	    av = (AV *)SvRV( events );
+
+	    if ( SvOK( uiref ) )
+	    {
+		if ( !sv_isobject( uiref ) || !sv_derived_from( uiref, "P4::UI" ) )
+		{
+		    warn( "P4::Client::_Replay() - uiref is not a P4::UI object" );
+		    XSRETURN_UNDEF;
+		}
+		ui = cup = new ClientUserPerl( uiref );
+		cup->SetTrace( ExtractTrace( THIS ) );
+		cup->DoPerlDiffs( DoPerlDiffs( THIS ) );
+		cup->LazyRecords( LazyRecords( THIS ) );
+		cup->Utf8Mode( Utf8Mode( THIS ) );
+		cup->SetAggregate( ExtractAggregate( THIS ) );
+		cup->SetHaveIndex( GetHaveIndex( THIS, cmd, 0, 0 ), cmd );
+	    }
+	    else
+	    {
+		ui = collect = new ClientUserCollect;
+		collect->SetUtf8( Utf8Mode( THIS ) );
+	    }
+
+	    ReplayEvents( av, ui );
+
+	    if ( collect )
+	    {
+		RETVAL = newSV( 0 );
+		sv_setref_pv( RETVAL, "P4::Client::Results", (void *)collect );
+	    }
+	    else
+	    {
+		delete cup;
+		RETVAL = newSViv( 1 );
+	    }
+
+	OUTPUT:
+	    RETVAL
+
+SV *
+_Input( THIS, uiref, specdef = NULL )
+	SV	*THIS
+	SV	*uiref
+	char	*specdef
+
+	INIT:
+	    ClientUserPerl	*cup;
+	    StrBufDict		vars;
+	    StrBuf		input;
+	    Error		e;
+
+	CODE:
+	    /*
+	     * Used by the tests: returns what the UI's InputData() would
+	     * send to the server for a command whose spec is specdef.
+	     */
+	    if ( !sv_isobject( uiref ) || !sv_derived_from( uiref, "P4::UI" ) )
+	    {
+		warn( "P4::Client::_Input() - uiref is not a P4::UI object" );
+		XSRETURN_UNDEF;
+	    }
+
+	    if ( specdef )
+		vars.SetVar( "specdef", specdef );
+
+	    cup = new ClientUserPerl( uiref );
+	    cup->SetTrace( ExtractTrace( THIS ) );
+	    cup->Utf8Mode( Utf8Mode( THIS ) );
+	    cup->varList = &vars;
+	    cup->InputData( &input, &e );
+	    delete cup;
+
+	    RETVAL = newSVpv( input.Text(), input.Length() );
+
+	OUTPUT:
+	    RETVAL
+
+SV *
+_PlanSync( THIS, shards, listing, output = 0 )
+	SV	*THIS
+	int	shards
+	SV	*listing
+	SV	*output
+
+	INIT:
+	    P4Settings		settings;
+	    ParallelSync	*ps;
+	    AV			*plan;
+
+	CODE:
+	    /*
+	     * Used by the tests: shares out the files of a made up 
+	     * "sync -n" listing as ParallelSync() would, then counts the 
+	     * files each shard's made up sync output says were synced.
+	     * Returns an array with a hash for each shard:
+	     *   { files => [ ... ], bytes => n, synced => n, 
+	     *     syncedBytes => n }
+	     */
+	    if ( !SvROK( listing ) || SvTYPE( SvRV( listing ) ) != SVt_PVAV )
+	    {
+		warn( "P4::Client::_PlanSync() - listing must be an array reference" );
+		XSRETURN_UNDEF;
+	    }
+
+	    ps = new ParallelSync( &settings, shards );
+	    ReplayEvents( (AV *)SvRV( listing ), ps->Listing() );
+	    ps->Load();
+
+	    plan = newAV();
+	    for ( int i = 0; i < ps->Shards(); i++ )
+	    {
+		HV	*hv = newHV();
+		AV	*files = newAV();
+		SV	**svp;
+		double	bytes;
+		int	synced;
+
+		for ( int j = 0; j < ps->ShardFiles( i ); j++ )
+		{
+		    const StrPtr *f = ps->ShardFile( i, j );
+		    av_push( files, newSVpv( f->Text(), f->Length() ) );
+		}
+
+		if ( output && SvROK( output ) && 
+		     SvTYPE( SvRV( output ) ) == SVt_PVAV &&
+		     ( svp = av_fetch( (AV *)SvRV( output ), i, 0 ) ) &&
+		     SvROK( *svp ) && SvTYPE( SvRV( *svp ) ) == SVt_PVAV )
+		    ReplayEvents( (AV *)SvRV( *svp ), ps->Output( i ) );
+		synced = ps->Synced( i, bytes );
+
+		hv_store( hv, "files", 5, newRV_noinc( (SV *)files ), 0 );
+		hv_store( hv, "bytes", 5, newSVnv( ps->ShardBytes( i ) ), 0 );
+		hv_store( hv, "synced", 6, newSViv( synced ), 0 );
+		hv_store( hv, "syncedBytes", 11, newSVnv( bytes ), 0 );
+		av_push( plan, newRV_noinc( (SV *)hv ) );
+	    }
+	    delete ps;
+
+	    RETVAL = newRV_noinc( (SV *)plan );
+
+	OUTPUT:
+	    RETVAL
+
+
+
+MODULE = P4::Client		PACKAGE = P4::Client::HaveIndex
+
+HaveIndex *
+new( CLASS, path )
+	char	*CLASS
+	char	*path
+
+	INIT:
+	    Error	e;
+	    StrBuf	msg;
+
+	CODE:
+	    RETVAL = new HaveIndex;
+	    if ( ! RETVAL->Open( path, &e ) )
+	    {
+		e.Fmt( &msg );
+		warn( msg.Text() );
+		delete RETVAL;
+		XSRETURN_UNDEF;
+	    }
+
+	OUTPUT:
+	    RETVAL
+
+void
+DESTROY( THIS )
+	HaveIndex	*THIS
+
+	INIT:
+	    Error	e;
+	    StrBuf	msg;
+
+	CODE:
+	    if ( THIS->Dirty() && ! THIS->Save( &e ) )
+	    {
+		e.Fmt( &msg );
+		warn( msg.Text() );
+	    }
+	    delete THIS;
+
+SV *
+_Build( THIS, client, digests, ... )
+	HaveIndex	*THIS
+	SV		*client
+	int		digests
+
+	INIT:
+	    ClientApi	*c;
+	    ClientApi	conn;
+	    P4Settings	settings;
+	    HaveLoad	*load;
+	    Error	e;
+	    StrBuf	msg;
+	    StrBuf	spec;
+	    I32		va_start = 3;
+	    I32		argc = 0;
+	    char	**args = NULL;
+
+	CODE:
+	    c = ExtractClient( client );
+	    if ( ! c )
+	       	XSRETURN_UNDEF;
+
+	    /*
+	     * Use a connection of our own so that we can turn on tagged
+	     * output without upsetting the caller's.
+	     */
+	    ExtractSettings( client, c, &settings );
+	    settings.SetProtocol( "tag", "" );
+	    if ( ! settings.Connect( &conn, &e ) )
+	    {
+		e.Fmt( &msg );
+		warn( msg.Text() );
+		XSRETURN_UNDEF;
+	    }
+
+	    New( 0, args, items - va_start + 2, char * );
+	    if ( digests )
+		args[ argc++ ] = (char *)"-Ol";
+	    for ( I32 i = va_start; i < items; i++ )
+		args[ argc++ ] = SvPV( ST( i ), PL_na );
+
+	    // Unlike "have", fstat needs to be told which files
+	    if ( digests && items == va_start )
+	    {
+		spec << "//" << c->GetClient() << "/...";
+		args[ argc++ ] = spec.Text();
+	    }
+
+	    load = new HaveLoad( THIS );
+	    conn.SetArgv( argc, args );
+	    conn.Run( digests ? "fstat" : "have", load );
+	    conn.Final( &e );
+	    Safefree( args );
+
+	    // Leave the index, and the file, as they were if the load failed
+	    if ( load->Errors() )
+	    {
+		load->LastError()->Fmt( &msg );
+		delete load;
+		warn( msg.Text() );
+		XSRETURN_UNDEF;
+	    }
+	    load->Apply();
+	    delete load;
+
+	    e.Clear();
+	    if ( ! THIS->Save( &e ) )
+	    {
+		e.Fmt( &msg );
+		warn( msg.Text() );
+		XSRETURN_UNDEF;
+	    }
+	    RETVAL = newSViv( THIS->Count() );
+
+	OUTPUT:
+	    RETVAL
+
+SV *
+Check( THIS, client, ... )
+	HaveIndex	*THIS
+	SV		*client
+
+	INIT:
+	    ClientApi	*c;
+	    Error	*e;
+	    SV		*count;
+	    HaveCheck	*check;
+	    HV		*result;
+	    I32		va_start = 2;
+	    I32		argc = 0;
+	    char	**args = NULL;
+
+	CODE:
+	    if ( ! ExtractData( client, &e, &c, &count ) )
+		XSRETURN_UNDEF;
+
+	    if ( ! SvIV( count ) )
+	    {
+		warn( "P4::Client::HaveIndex::Check() - client has not been initialised" );
+		XSRETURN_UNDEF;
+	    }
+
+	    if ( items > va_start )
+	    {
+		New( 0, args, items - va_start, char * );
+		for ( I32 i = va_start; i < items; i++ )
+		    args[ argc++ ] = SvPV( ST( i ), PL_na );
+	    }
+
+	    check = new HaveCheck( THIS );
+	    c->SetArgv( argc, args );
+	    c->Run( "have", check );
+
+	    // Extra files only make sense if we looked at everything
+	    if ( ! argc )
+		check->Finish();
+
+	    result = newHV();
+	    hv_store( result, "missing", 7, 
+	    		newRV_noinc( (SV *)StrBufsToArray( check->Missing() ) ), 0 );
+	    hv_store( result, "stale", 5, 
+	    		newRV_noinc( (SV *)StrBufsToArray( check->Stale() ) ), 0 );
+	    hv_store( result, "extra", 5, 
+	    		newRV_noinc( (SV *)StrBufsToArray( check->Extra() ) ), 0 );
+	    hv_store( result, "errors", 6, newSViv( check->Errors() ), 0 );
+	    RETVAL = newRV_noinc( (SV *)result );
+
+	    delete check;
+	    if ( args ) Safefree( args );
+
+	OUTPUT:
+	    RETVAL
+
+int
+Count( THIS )
+	HaveIndex	*THIS
+
+	CODE:
+	    RETVAL = THIS->Count();
+
+	OUTPUT:
+	    RETVAL
+
+SV *
+HaveRev( THIS, path )
+	HaveIndex	*THIS
+	SV		*path
+
+	INIT:
+	    HaveEntry	entry;
+	    STRLEN	len;
+	    char	*p;
+
+	CODE:
+	    p = SvPV( path, len );
+	    if ( ! THIS->Lookup( StrRef( p, len ), &entry ) )
+		XSRETURN_UNDEF;
+	    RETVAL = newSViv( entry.rev );
+
+	OUTPUT:
+	    RETVAL
+
+SV *
+Lookup( THIS, path )
+	HaveIndex	*THIS
+	SV		*path
+
+	INIT:
+	    HaveEntry	entry;
+	    HV		*hv;
+	    STRLEN	len;
+	    char	*p;
+
+	CODE:
+	    p = SvPV( path, len );
+	    if ( ! THIS->Lookup( StrRef( p, len ), &entry ) )
+		XSRETURN_UNDEF;
+
+	    hv = newHV();
+	    hv_store( hv, "depotFile", 9, newSVpv( entry.depotFile.Text(), 
+	    			entry.depotFile.Length() ), 0 );
+	    hv_store( hv, "clientFile", 10, newSVpv( entry.clientFile.Text(), 
+	    			entry.clientFile.Length() ), 0 );
+	    hv_store( hv, "haveRev", 7, newSViv( entry.rev ), 0 );
+	    if ( entry.digest.Length() )
+		hv_store( hv, "digest", 6, newSVpv( entry.digest.Text(), 
+				entry.digest.Length() ), 0 );
+	    RETVAL = newRV_noinc( (SV *)hv );
+
+	OUTPUT:
+	    RETVAL
+
+void
+Save( THIS )
+	HaveIndex	*THIS
+
+	INIT:
+	    Error	e;
+	    StrBuf	msg;
+
+	CODE:
+	    if ( ! THIS->Save( &e ) )
+	    {
+		e.Fmt( &msg );
+		warn( msg.Text() );
+		XSRETURN_NO;
+	    }
+	    XSRETURN_YES;
+
+
+
+MODULE = P4::Client		PACKAGE = P4::Client::Record
+
+void
+DESTROY( THIS )
+	StatRecord	*THIS
+
+	CODE:
+	    delete THIS;
+
+SV *
+Get( THIS, key )
+	StatRecord	*THIS
+	SV		*key
+
+	INIT:
+	    STRLEN	len;
+	    char	*k;
+	    StrRef	only;
+
+	CODE:
+	    k = SvPV( key, len );
+	    only.Set( k, len );
+	    if ( ! ( RETVAL = ClientUserPerl::HashValue( THIS, &only, 
+	    						 THIS->Utf8() ) ) )
+		XSRETURN_UNDEF;
+
+	OUTPUT:
+	    RETVAL
+
+void
+Keys( THIS )
+	StatRecord	*THIS
+
+	INIT:
+	    StrHash	keys;
+	    StrRef	var, val;
+	    StrBuf	base, index;
+
+	PPCODE:
+	    /*
+	     * The keys that DictToHash() would create. See 
+	     * ClientUserPerl::InsertItem().
+	     */
+	    for ( int i = 0; THIS->GetVar( i, var, val ); i++ )
+	    {
+		if ( var == "func" ) continue;
+
+		ClientUserPerl::SplitKey( &var, base, index );
+		if ( index == "" && keys.Contains( base ) )
+		    base.Append( "s" );
+		keys.Insert( base, 0 );
+	    }
+
+	    EXTEND( SP, keys.Count() );
+	    for ( int i = 0; i < keys.Count(); i++ )
+	    {
+		const StrPtr *k = keys.Key( i );
+		PUSHs( sv_2mortal( ClientUserPerl::NewString( k->Text(), 
+						k->Length(), THIS->Utf8() ) ) );
+	    }
+
+SV *
+Materialize( THIS )
+	StatRecord	*THIS
+
+	INIT:
+	    HV		*hv;
+
+	CODE:
+	    hv = newHV();
+	    ClientUserPerl::DictToHash( THIS, hv, 0, THIS->Utf8() );
+	    RETVAL = newRV_noinc( (SV *)hv );
+
+	OUTPUT:
+	    RETVAL
+
+
+MODULE = P4::Client		PACKAGE = P4::Client::Results
+
+void
+DESTROY( THIS )
+	ClientUserCollect	*THIS
+
+	CODE:
+	    delete THIS;
+
+int
+Count( THIS )
+	ClientUserCollect	*THIS
+
+	CODE:
+	    RETVAL = THIS->Records()->Count();
+
+	OUTPUT:
+	    RETVAL
+
+void
+Errors( THIS )
+	ClientUserCollect	*THIS
+
+	PPCODE:
+	    for ( int i = 0; i < THIS->Count(); i++ )
+	    {
+		if ( THIS->Type( i ) != CT_ERROR )
+		    continue;
+
+		const StrPtr *t = THIS->Text( i );
+		XPUSHs( sv_2mortal( ClientUserPerl::NewString( t->Text(), 
+						t->Length(), THIS->Utf8() ) ) );
+	    }
+
+SV *
+Get( THIS, index )
+	ClientUserCollect	*THIS
+	int			index
+
+	INIT:
+	    StrBufDict	d;
+	    HV		*hv;
+
+	CODE:
+	    if ( index < 0 || index >= THIS->Records()->Count() )
+		XSRETURN_UNDEF;
+
+	    THIS->Records()->Dict( index, &d );
+	    hv = newHV();
+	    ClientUserPerl::DictToHash( &d, hv, 0, THIS->Utf8() );
+	    RETVAL = newRV_noinc( (SV *)hv );
+
+	OUTPUT:
+	    RETVAL
+
+void
+Select( THIS, field, prefix )
+	ClientUserCollect	*THIS
+	SV			*field
+	SV			*prefix
+
+	INIT:
+	    ResultStore	*rs;
+	    StrRef	f, p;
+	    STRLEN	len;
+	    char	*s;
+	    int		dir;
+
+	PPCODE:
+	    /*
+	     * The numbers of the records whose field is a path beneath 
+	     * the directory prefix.
+	     */
+	    rs = THIS->Records();
+	    s = SvPV( field, len );
+	    f.Set( s, len );
+	    s = SvPV( prefix, len );
+	    p.Set( s, len );
+
+	    if ( ( dir = rs->Paths()->FindDir( p ) ) < 0 )
+		XSRETURN_EMPTY;
+
+	    for ( int i = 0; i < rs->Count(); i++ )
+		if ( rs->Under( i, f, dir ) )
+		    XPUSHs( sv_2mortal( newSViv( i ) ) );
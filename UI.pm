@@ -161,6 +161,12 @@ sub Prompt($)
 	return <>;
 }
 
+# Progress report from P4::Client::ParallelSync(). Does nothing by default.
+sub SyncProgress($$$$)
+{
+    my ($self, $files, $totalFiles, $bytes, $totalBytes ) = @_;
+}
+
 
 #
 # Function to diff two files. This default implementation does nothing of
@@ -218,6 +224,14 @@ output from the Perforce server is simply written to stdout, and input
 comes from stdin. In order to do anything clever, you will need to 
 derive a subclass from P4::UI and override the appropriate methods.
 
+As an optimisation, P4::Client doesn't call the OutputInfo(), 
+OutputError(), OutputStat() and OutputText() methods below if your 
+UI object inherits them unchanged. It writes the same output to STDOUT
+and STDERR itself. Overriding a method in your subclass makes 
+P4::Client call it as usual. The Perl methods are also used whenever
+the output handle is tied or has a :utf8 layer, or C<$,> or C<$\> are
+set.
+
 =head2 EXPORTS
 
 	UI::new()	- Create a new user interface object
@@ -282,6 +296,12 @@ derive a subclass from P4::UI and override the appropriate methods.
 	Prints the prompt string $prompt and then reads a line
 	of input from the user returning the input line.
 
+=item C<SyncProgress( $files, $totalFiles, $bytes, $totalBytes )>
+
+	Called periodically by P4::Client::ParallelSync() with the
+	number of files and bytes synced so far, and the totals. The
+	default implementation does nothing.
+
 =item C<Diff( $f1, $f2, $flags, $differ )>
 
 	Diff two files manually. The default implementation of this method
@@ -24,4 +24,4 @@
 $self->{CC} 		= "c++";
 $self->{LD} 		= "c++";
 $self->{DEFINE} 	.= " -DOS_FREEBSD ";
-$self->{LIBS}		= [ "-lgcc" ];
+$self->{LIBS}		= [ "-lgcc -lpthread" ];
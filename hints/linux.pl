@@ -24,6 +24,7 @@
 $self->{CC} 		= "c++";
 $self->{LD} 		= "c++";
 $self->{DEFINE} 	.= " -DOS_LINUX -Dconst_char='char'";
+$self->{LIBS}		= [ "-lpthread" ];
 
 # Some Perl builds - notably ActiveState, but also some Red Hat ones use very
 # restrictive preprocessor settings which are no good to us. So, just to be
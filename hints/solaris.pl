@@ -25,7 +25,7 @@ $self->{CC} 		= "c++";
 $self->{LD} 		= "c++";
 
 $self->{DEFINE} .= " -Dsolaris";
-$self->{LIBS} = [ "-lsocket", "-lnsl" ];
+$self->{LIBS} = [ "-lsocket -lnsl -lpthread" ];
 
 my $osver = `uname -r`;
 if ( $osver eq "5.5" )
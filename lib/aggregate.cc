@@ -0,0 +1,278 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "strhash.h"
+#include "aggregate.h"
+
+struct AggregateGroup
+{
+	const StrPtr	*key;
+	int		count;
+	double		*value;
+	char		*seen;
+	double		order;
+};
+
+
+Aggregate::Aggregate()
+{
+	depth = 0;
+	top = 0;
+	by = -1;
+	nOps = 0;
+	groups = new StrHash;
+	rows = 0;
+	nRows = 0;
+	sorted = 0;
+}
+
+Aggregate::~Aggregate()
+{
+	Reset();
+	for ( int j = 0; j < nOps; j++ )
+	    delete opField[ j ];
+	delete groups;
+}
+
+/*
+ * Group on the value of field. If depth is non-zero, the field is taken
+ * to be a path and only the first depth directories of it are used, so
+ * a depth of 2 groups "//depot/main/src/x.c" under "//depot/main". 
+ * With no field at all, everything goes in a single group.
+ */
+void
+Aggregate::SetGroup( const char *field, int depth )
+{
+	group.Set( field ? field : "" );
+	this->depth = depth;
+}
+
+/*
+ * Returns the index of the new op, or -1 if there are too many.
+ */
+int
+Aggregate::AddOp( int op, const char *field )
+{
+	if ( nOps == AG_MAXOPS )
+	    return -1;
+
+	opType[ nOps ] = op;
+	opField[ nOps ] = new StrBuf;
+	opField[ nOps ]->Set( field );
+	return nOps++;
+}
+
+/*
+ * Only return the n largest groups, as ordered by the value of op by, or
+ * by the count if by is -1. n of 0 means return them all.
+ */
+void
+Aggregate::SetTop( int n, int by )
+{
+	top = n;
+	this->by = by;
+	sorted = 0;
+}
+
+void
+Aggregate::Reset()
+{
+	for ( int i = 0; i < groups->Count(); i++ )
+	{
+	    AggregateGroup *g = (AggregateGroup *)groups->Value( i );
+	    delete [] g->value;
+	    delete [] g->seen;
+	    delete g;
+	}
+	groups->Clear();
+
+	delete [] rows;
+	rows = 0;
+	nRows = 0;
+	sorted = 0;
+}
+
+void
+Aggregate::GroupKey( const StrPtr *val, StrRef &key )
+{
+	const char	*p = val->Text();
+	const char	*end = p + val->Length();
+	int		n = depth;
+
+	if ( ! n )
+	{
+	    key.Set( val->Text(), val->Length() );
+	    return;
+	}
+
+	// Skip the leading "//" of a depot path or "/" of a local one
+	while ( p < end && ( *p == '/' || *p == '\\' ) )
+	    p++;
+
+	for ( ; p < end; p++ )
+	    if ( ( *p == '/' || *p == '\\' ) && ! --n )
+		break;
+
+	key.Set( val->Text(), p - val->Text() );
+}
+
+void
+Aggregate::Add( StrDict *d )
+{
+	AggregateGroup	*g;
+	StrPtr		*val;
+	StrRef		key;
+
+	if ( group.Length() )
+	{
+	    // Records without the field aren't counted
+	    if ( ! ( val = d->GetVar( group ) ) )
+		return;
+	    GroupKey( val, key );
+	}
+
+	if ( ! ( g = (AggregateGroup *)groups->Find( key ) ) )
+	{
+	    g = new AggregateGroup;
+	    g->count = 0;
+	    g->value = new double[ nOps ? nOps : 1 ];
+	    g->seen = new char[ nOps ? nOps : 1 ];
+	    memset( g->seen, 0, nOps );
+	    groups->Insert( key, g );
+	    g->key = groups->Key( groups->Count() - 1 );
+	}
+
+	g->count++;
+	sorted = 0;
+
+	for ( int j = 0; j < nOps; j++ )
+	{
+	    char	*e;
+	    double	v;
+
+	    if ( ! ( val = d->GetVar( *opField[ j ] ) ) )
+		continue;
+
+	    v = strtod( val->Text(), &e );
+	    if ( e == val->Text() )
+		continue;
+
+	    if ( ! g->seen[ j ] )
+	    {
+		g->value[ j ] = v;
+		g->seen[ j ] = 1;
+		continue;
+	    }
+
+	    switch ( opType[ j ] )
+	    {
+	    case AG_SUM: g->value[ j ] += v; break;
+	    case AG_MIN: if ( v < g->value[ j ] ) g->value[ j ] = v; break;
+	    case AG_MAX: if ( v > g->value[ j ] ) g->value[ j ] = v; break;
+	    }
+	}
+}
+
+static int
+CompareGroups( const void *a, const void *b )
+{
+	AggregateGroup	*ga = *(AggregateGroup **)a;
+	AggregateGroup	*gb = *(AggregateGroup **)b;
+
+	if ( ga->order != gb->order )
+	    return ga->order > gb->order ? -1 : 1;
+
+	return strcmp( ga->key->Text(), gb->key->Text() );
+}
+
+void
+Aggregate::Sort()
+{
+	int	n = groups->Count();
+
+	delete [] rows;
+	rows = new AggregateGroup *[ n ? n : 1 ];
+
+	for ( int i = 0; i < n; i++ )
+	{
+	    AggregateGroup *g = (AggregateGroup *)groups->Value( i );
+
+	    if ( by < 0 || by >= nOps )
+		g->order = g->count;
+	    else
+		g->order = g->seen[ by ] ? g->value[ by ] : 0;
+
+	    rows[ i ] = g;
+	}
+
+	qsort( rows, n, sizeof( AggregateGroup * ), CompareGroups );
+
+	nRows = top && top < n ? top : n;
+	sorted = 1;
+}
+
+int
+Aggregate::Count()
+{
+	if ( ! sorted ) Sort();
+	return nRows;
+}
+
+const StrPtr *
+Aggregate::Group( int i )
+{
+	if ( ! sorted ) Sort();
+	return rows[ i ]->key;
+}
+
+int
+Aggregate::GroupCount( int i )
+{
+	if ( ! sorted ) Sort();
+	return rows[ i ]->count;
+}
+
+/*
+ * Returns 0 if none of the records in the group had a numeric value for
+ * the op's field.
+ */
+int
+Aggregate::Value( int i, int j, double &v )
+{
+	if ( ! sorted ) Sort();
+	if ( ! rows[ i ]->seen[ j ] )
+	    return 0;
+
+	v = rows[ i ]->value[ j ];
+	return 1;
+}
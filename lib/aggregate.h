@@ -0,0 +1,91 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * Aggregate - group tagged output records by a field, or by the first
+ * few directories of a path field, and count them, summing and taking
+ * the minimum and maximum of numeric fields as we go. Only the table of
+ * groups is kept, not the records.
+ */
+
+#define AG_MAXOPS	32
+
+enum AggregateOp
+{
+	AG_SUM,
+	AG_MIN,
+	AG_MAX
+};
+
+struct AggregateGroup;
+class StrHash;
+
+class Aggregate
+{
+    public:
+			Aggregate();
+			~Aggregate();
+
+		// Setup
+		void	SetGroup( const char *field, int depth );
+		int	AddOp( int op, const char *field );
+		void	SetTop( int n, int by );
+		void	Reset();
+
+		void	Add( StrDict *d );
+
+		// Results, in descending order of count, or of the value
+		// of the op given to SetTop()
+		int	Ops()		{ return nOps; }
+		int	OpType( int j )	{ return opType[ j ]; }
+	const StrPtr	*OpField( int j ) { return opField[ j ]; }
+
+		int	Count();
+	const StrPtr	*Group( int i );
+		int	GroupCount( int i );
+		int	Value( int i, int j, double &v );
+
+    private:
+		void	GroupKey( const StrPtr *val, StrRef &key );
+		void	Sort();
+
+    private:
+	StrBuf		group;
+	int		depth;
+	int		top;
+	int		by;
+
+	int		nOps;
+	int		opType[ AG_MAXOPS ];
+	StrBuf		*opField[ AG_MAXOPS ];
+
+	StrHash		*groups;
+	AggregateGroup	**rows;
+	int		nRows;
+	int		sorted;
+};
@@ -0,0 +1,236 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+#include "vararray.h"
+
+#include "resultstore.h"
+#include "clientusercollect.h"
+
+struct CollectEvent
+{
+	int		type;
+	int		level;
+	StrBuf		text;
+	int		record;
+};
+
+
+ClientUserCollect::ClientUserCollect()
+{
+	errors = 0;
+	warnings = 0;
+	records = new ResultStore;
+	dict = 0;
+	utf8 = 0;
+}
+
+ClientUserCollect::~ClientUserCollect()
+{
+	Clear();
+	delete records;
+	delete dict;
+}
+
+void
+ClientUserCollect::Clear()
+{
+	for ( int i = 0; i < events.Count(); i++ )
+	    delete (CollectEvent *)events.Get( i );
+	events.Clear();
+	records->Clear();
+	errors = 0;
+	warnings = 0;
+}
+
+CollectEvent *
+ClientUserCollect::Add( int type )
+{
+	CollectEvent *ev = new CollectEvent;
+	ev->type = type;
+	ev->level = 0;
+	ev->record = -1;
+	events.Put( ev );
+	return ev;
+}
+
+void
+ClientUserCollect::ErrorPause( char *errBuf, Error *e )
+{
+	OutputError( errBuf );
+}
+
+void
+ClientUserCollect::HandleError( Error *err )
+{
+	CollectEvent *ev = Add( CT_ERROR );
+
+	err->Fmt( &ev->text );
+	ev->level = err->GetSeverity();
+
+	if ( ev->level >= E_FAILED )
+	    errors++;
+	else if ( ev->level == E_WARN )
+	    warnings++;
+}
+
+void
+ClientUserCollect::InputData( StrBuf *strbuf, Error *e )
+{
+	strbuf->Set( input );
+}
+
+void
+ClientUserCollect::OutputError( const_char *errBuf )
+{
+	CollectEvent *ev = Add( CT_ERROR );
+	ev->text.Set( errBuf );
+	ev->level = E_FAILED;
+	errors++;
+}
+
+void
+ClientUserCollect::OutputInfo( char level, const_char *data )
+{
+	CollectEvent *ev = Add( CT_INFO );
+	ev->level = level;
+	ev->text.Set( data );
+}
+
+void
+ClientUserCollect::OutputStat( StrDict *varList )
+{
+	CollectEvent 	*ev = Add( CT_STAT );
+
+	ev->record = records->Add( varList );
+}
+
+void
+ClientUserCollect::OutputText( const_char *data, int length )
+{
+	CollectEvent *ev = Add( CT_TEXT );
+	ev->text.Set( data, length );
+}
+
+void
+ClientUserCollect::OutputBinary( const_char *data, int length )
+{
+	CollectEvent *ev = Add( CT_BINARY );
+	ev->text.Set( data, length );
+}
+
+void
+ClientUserCollect::Prompt( const StrPtr &msg, StrBuf &rsp, 
+				int noEcho, Error *e )
+{
+	rsp.Clear();
+}
+
+void
+ClientUserCollect::Edit( FileSys *f1, Error *e )
+{
+}
+
+int
+ClientUserCollect::Count()
+{
+	return events.Count();
+}
+
+int
+ClientUserCollect::Type( int i )
+{
+	return ((CollectEvent *)events.Get( i ))->type;
+}
+
+int
+ClientUserCollect::Level( int i )
+{
+	return ((CollectEvent *)events.Get( i ))->level;
+}
+
+/*
+ * The dictionary is rebuilt on each call, and is only valid until the
+ * next one.
+ */
+StrDict *
+ClientUserCollect::Dict( int i )
+{
+	int	rec = ((CollectEvent *)events.Get( i ))->record;
+
+	if ( rec < 0 )
+	    return 0;
+
+	delete dict;
+	dict = new StrBufDict;
+	records->Dict( rec, dict );
+	return dict;
+}
+
+const StrPtr *
+ClientUserCollect::Text( int i )
+{
+	return &((CollectEvent *)events.Get( i ))->text;
+}
+
+/*
+ * Send everything we've collected to another ClientUser in the order
+ * in which it arrived. The mask selects which types of event to send.
+ * Only call this on the thread that owns the target.
+ */
+
+void
+ClientUserCollect::Replay( ClientUser *ui, int mask )
+{
+	for ( int i = 0; i < events.Count(); i++ )
+	{
+	    CollectEvent *ev = (CollectEvent *)events.Get( i );
+
+	    if ( ! ( mask & CT_MASK( ev->type ) ) )
+		continue;
+
+	    switch( ev->type )
+	    {
+	    case CT_INFO:
+		ui->OutputInfo( (char)ev->level, ev->text.Text() );
+		break;
+	    case CT_ERROR:
+		ui->OutputError( ev->text.Text() );
+		break;
+	    case CT_STAT:
+		ui->OutputStat( Dict( i ) );
+		break;
+	    case CT_TEXT:
+		ui->OutputText( ev->text.Text(), ev->text.Length() );
+		break;
+	    case CT_BINARY:
+		ui->OutputBinary( ev->text.Text(), ev->text.Length() );
+		break;
+	    }
+	}
+}
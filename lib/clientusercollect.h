@@ -0,0 +1,105 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * ClientUserCollect - a ClientUser which doesn't talk to Perl at all. It
+ * simply records everything the server sends it so that commands can be
+ * run on native threads and their output handed back to Perl later, on
+ * the Perl thread, by calling Replay() with a ClientUserPerl object.
+ *
+ * Commands which want input ("p4 xxx -i") are given whatever was passed
+ * to SetInput(). Prompts get an empty response and editors aren't run.
+ *
+ * Tagged output is kept in a ResultStore rather than as a dictionary
+ * per record, as large listings are mostly paths with common prefixes.
+ */
+
+enum CollectType
+{
+	CT_INFO,
+	CT_ERROR,
+	CT_STAT,
+	CT_TEXT,
+	CT_BINARY
+};
+
+#define CT_ALL		0xff
+#define CT_MASK( t )	( 1 << ( t ) )
+
+struct CollectEvent;
+class ResultStore;
+
+class ClientUserCollect : public ClientUser
+{
+    public:
+			ClientUserCollect();
+	virtual		~ClientUserCollect();
+
+	virtual void	ErrorPause( char *errBuf, Error *e );
+	virtual void 	HandleError( Error *err );
+	virtual void	InputData( StrBuf *strbuf, Error *e );
+	virtual void 	OutputError( const_char *errBuf );
+	virtual void	OutputInfo( char level, const_char *data );
+	virtual void	OutputStat( StrDict *varList );
+	virtual void 	OutputText( const_char *data, int length );
+	virtual void 	OutputBinary( const_char *data, int length );
+	virtual void	Prompt( const StrPtr &msg, StrBuf &rsp, 
+				int noEcho, Error *e );
+	virtual void	Edit( FileSys *f1, Error *e );
+
+		void	SetInput( const StrPtr &i )	{ input.Set( i ); }
+		void	Replay( ClientUser *ui, int mask = CT_ALL );
+		void	Clear();
+
+		int	Count();
+		int	Type( int i );
+		int	Level( int i );
+		StrDict	*Dict( int i );
+	const StrPtr	*Text( int i );
+	ResultStore	*Records()	{ return records; }
+
+		// The Utf8Policy to use when handing results to Perl
+		void	SetUtf8( int m )	{ utf8 = m; }
+		int	Utf8()		{ return utf8; }
+
+		int	Errors()	{ return errors; }
+		int	Warnings()	{ return warnings; }
+
+    private:
+	CollectEvent	*Add( int type );
+
+    private:
+	VarArray	events;
+	ResultStore	*records;
+	StrBufDict	*dict;
+	StrBuf		input;
+	int		errors;
+	int		warnings;
+	int		utf8;
+};
+
@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "clientapi.h"
 #include "spec.h"
 #include "diff.h"
+#include "vararray.h"
 
 /* When including Perl headers, make sure the linkage is C, not C++ */
 
@@ -78,19 +79,45 @@ extern "C"
  * Now proceed with the normal stuff
  ******************************************************************************/
 
+#include "p4trace.h"
 #include "clientuserperl.h"
+#include "haveindex.h"
+#include "statrecord.h"
+#include "aggregate.h"
+#include "utf8check.h"
+
+/*
+ * Output from the stock P4::UI methods is collected in a buffer of about 
+ * this size before being handed to PerlIO.
+ */
+#define OUTBUF_SIZE	65536
 
 
 ClientUserPerl::ClientUserPerl( SV * perlUI )
 { 
     this->perlUI 	= perlUI; 
-    debug 		= 0;
+    trace 		= 0;
     perlDiffs		= 0;
+    lazy		= 0;
+    utf8		= UTF8_OFF;
+    haveIndex		= 0;
+    aggregate		= 0;
+    outFp		= 0;
+    autoFlush		= 0;
+    stock		= StockMethods();
+}
+
+ClientUserPerl::~ClientUserPerl()
+{
+    FlushText();
+    FlushOutput();
 }
 
 void
 ClientUserPerl::Edit( FileSys *f1, Error *e )
 {
+	FlushOutput();
+
 	dTHX;
 	dSP;
 	ENTER;
@@ -114,6 +141,8 @@ ClientUserPerl::Edit( FileSys *f1, Error *e )
 void	
 ClientUserPerl::ErrorPause( char *errBuf, Error *e )
 {
+	FlushOutput();
+
 	dTHX;
 	dSP;
 	ENTER;
@@ -121,7 +150,7 @@ ClientUserPerl::ErrorPause( char *errBuf, Error *e )
 	PUSHMARK(SP);
 
 	XPUSHs( perlUI );
-	XPUSHs( sv_2mortal( newSVpv( errBuf, 0 ) ) );
+	XPUSHs( sv_2mortal( NewString( errBuf, strlen( errBuf ), utf8 ) ) );
 	PUTBACK;
 
 	PERL_CALL_METHOD( "ErrorPause", G_VOID );
@@ -139,15 +168,39 @@ ClientUserPerl::HandleError( Error *e )
 {
 	StrBuf	errBuf;
 
+	FlushText();
 	e->Fmt( &errBuf );
 	dTHX;
+
+#ifdef P4PERL_TRACE
+	if ( trace && trace->DumpOnError() )
+	{
+	    StrBuf	dump;
+	    trace->Dump( dump );
+	    PerlIO_write( PerlIO_stderr(), dump.Text(), dump.Length() );
+	    trace->Clear();
+	}
+#endif
+
+	if ( ( stock & UI_ERROR ) && StockError( errBuf.Text(), 
+						 errBuf.Length() ) )
+	    return;
+
+	FlushOutput();
+
 	dSP;
 	ENTER;
 	SAVETMPS;
 	PUSHMARK(SP);
 
+	// The stock version should write what StockError() would have
+	int policy = ( stock & UI_ERROR ) && 
+		     StockBytes( gv_fetchpv( "STDERR", FALSE, SVt_PVIO ) ) ? 
+		     0 : utf8;
+
 	XPUSHs( perlUI );
-	XPUSHs( sv_2mortal( newSVpv( errBuf.Text(), errBuf.Length() ) ) );
+	XPUSHs( sv_2mortal( NewString( errBuf.Text(), errBuf.Length(), 
+				       policy ) ) );
 	PUTBACK;
 
 	PERL_CALL_METHOD( "OutputError", G_VOID );
@@ -165,6 +218,8 @@ ClientUserPerl::InputData( StrBuf *strbuf, Error *e )
 	I32	n; 	/* Number of items returned */
 	int	useHash = 0;
 
+	FlushOutput();
+
 	dTHX;
 	dSP;
 	ENTER;
@@ -184,8 +239,7 @@ ClientUserPerl::InputData( StrBuf *strbuf, Error *e )
 	    return;
 	}
 
-	if ( debug )
-	    printf( "InputData: Received input from Perl space\n" );
+	P4TRACE( trace, TR_INPUT, 1, "received input from Perl space", 0, -1 );
 
 	SV *sv = POPs;
 	HV *hv;
@@ -195,8 +249,7 @@ ClientUserPerl::InputData( StrBuf *strbuf, Error *e )
 	    // We've been passed a reference - hopefully to a hash
 	    hv = (HV *)SvRV( sv );
 	    useHash = 1;
-	    if ( debug )
-		printf( "InputData: Input looks like a hash ref\n" );
+	    P4TRACE( trace, TR_INPUT, 1, "input is a hash ref", 0, -1 );
 	}
 	else if ( SvTYPE( sv ) == SVt_PV )
 	{
@@ -206,8 +259,7 @@ ClientUserPerl::InputData( StrBuf *strbuf, Error *e )
 	{
 	    hv = (HV *)sv;
 	    useHash = 1;
-	    if ( debug )
-		printf( "InputData: Input is hash.\n" );
+	    P4TRACE( trace, TR_INPUT, 1, "input is a hash", 0, -1 );
 	}
 	else
 	{
@@ -223,8 +275,12 @@ ClientUserPerl::InputData( StrBuf *strbuf, Error *e )
 	     * to our caller
 	     */
 
-	    if ( varList->GetVar( "specdef" ) )
-		HashToForm( hv, strbuf );
+	    StrPtr *specdef = varList->GetVar( "specdef" );
+	    if ( specdef )
+	    {
+		Spec	s( specdef->Text(), "" );
+		HashToForm( hv, &s, strbuf, trace );
+	    }
 	    else
 		warn( "Can't convert hashref into a form. No spec supplied" );
 	}
@@ -237,14 +293,26 @@ ClientUserPerl::InputData( StrBuf *strbuf, Error *e )
 void 	
 ClientUserPerl::OutputError( char *errBuf )
 {
+	FlushText();
+
+	if ( ( stock & UI_ERROR ) && StockError( errBuf, strlen( errBuf ) ) )
+	    return;
+
+	FlushOutput();
+
 	dTHX;
 	dSP;
 	ENTER;
 	SAVETMPS;
 	PUSHMARK(SP);
 
+	// The stock version should write what StockError() would have
+	int policy = ( stock & UI_ERROR ) && 
+		     StockBytes( gv_fetchpv( "STDERR", FALSE, SVt_PVIO ) ) ? 
+		     0 : utf8;
+
 	XPUSHs( perlUI );
-	XPUSHs( sv_2mortal( newSVpv( errBuf, 0 ) ) );
+	XPUSHs( sv_2mortal( NewString( errBuf, strlen( errBuf ), policy ) ) );
 	PUTBACK;
 
 	PERL_CALL_METHOD( "OutputError", G_VOID );
@@ -260,19 +328,32 @@ void
 ClientUserPerl::OutputInfo( char level, const_char *data )
 {
 	int	lev;
+
+	FlushText();
+
+	if ( haveIndex )
+	    haveIndex->ApplyInfo( command, data );
+
+	lev = level - '0';
+	if ( ( stock & UI_INFO ) && StockInfo( lev, data ) )
+	    return;
+
+	FlushOutput();
+
 	dTHX;
 	dSP;
 	ENTER;
 	SAVETMPS;
 	PUSHMARK(SP);
 
+	// The stock version should write what StockInfo() would have
+	int policy = ( stock & UI_INFO ) && StockBytes( PL_defoutgv ) ? 0 : utf8;
+
 	// Put args on stack
-	lev = level - '0';
 	XPUSHs( perlUI );
 	XPUSHs( sv_2mortal( newSViv( lev ) ) );
 
-	// Must cast to char * to keep perl 5.5 happy
-	XPUSHs( sv_2mortal( newSVpv( (char *)data, 0 ) ) );
+	XPUSHs( sv_2mortal( NewString( data, strlen( data ), policy ) ) );
 	PUTBACK;
 
 	PERL_CALL_METHOD( "OutputInfo", G_VOID );
@@ -287,7 +368,9 @@ ClientUserPerl::OutputInfo( char level, const_char *data )
 
 /*
  * Tagged output format. For this we create a hash mapping the tags
- * to the values. Then we pass the HV to the perl sub
+ * to the values. Then we pass the HV to the perl sub. In lazy mode we
+ * pass a P4::Client::Record instead, and the hash is only built if and
+ * when it's wanted.
  */
 void	
 ClientUserPerl::OutputStat( StrDict *varList )
@@ -301,19 +384,25 @@ ClientUserPerl::OutputStat( StrDict *varList )
 	SpecDataTable	specData;
 	Error		e;
 
+	FlushText();
+
+	if ( haveIndex )
+	    haveIndex->ApplyStat( command, varList );
+
+	// Records being aggregated don't go any further
+	if ( aggregate && ! ( spec && data ) )
+	{
+	    aggregate->Add( varList );
+	    return;
+	}
+
 	// Enter new Perl scope
 	dTHX;
 	dSP;
 	ENTER;
 	SAVETMPS;
-	PUSHMARK(SP);
 
-	if ( debug )
-	    printf( "OutputStat: starting to parse data\n" );
-
-	// Create a new HV and make it mortal
-	hv = newHV();
-	sv_2mortal( (SV *)hv );
+	P4TRACE( trace, TR_STAT, 1, "OutputStat", 0, -1 );
 
 	/*
 	 * If both spec and data are defined, then the user has set both the
@@ -325,8 +414,8 @@ ClientUserPerl::OutputStat( StrDict *varList )
 
 	if ( spec && data )
 	{
-	    if ( debug )
-		printf( "OutputStat: spec and data both defined\n" );
+	    P4TRACE( trace, TR_STAT, 1, "parsing spec data", 0, 
+	    		data->Length() );
 	    Spec s( spec->Text(), "" );
 
 	    // Use ParseNoValid to avoid invalid data in the form causing
@@ -340,18 +429,47 @@ ClientUserPerl::OutputStat( StrDict *varList )
 	    input = specData.Dict();
 	}
 
-	// Now store the rest
-	if ( debug )
-	    printf( "OutputStat: Converting dictionary to hash\n" );
+	/*
+	 * The stock P4::UI::OutputStat() needs a real hash, so lazy mode
+	 * only applies when it's been overridden.
+	 */
+	if ( lazy && ! ( stock & UI_STAT ) )
+	{
+	    StatRecord *r = new StatRecord( input );
+
+	    r->SetUtf8( utf8 );
+	    href = sv_newmortal();
+	    sv_setref_pv( href, "P4::Client::Record", (void *)r );
+	}
+	else
+	{
+	    // Create a new HV and make it mortal
+	    hv = newHV();
+	    sv_2mortal( (SV *)hv );
+
+	    DictToHash( input, hv, trace, utf8 );
 
-	DictToHash( input, hv );
+	    P4TRACE( trace, TR_STAT, 1, "converted to hash", 0, 
+	    		HvKEYS( hv ) );
 
-	if ( debug )
-	    printf( "OutputStat: Conversion done.\n" );
+	    if ( ( stock & UI_STAT ) && StockStat( hv ) )
+	    {
+		FREETMPS;
+		LEAVE;
+		return;
+	    }
 
+	    // The stock version should write what StockStat() would have
+	    if ( ( stock & UI_STAT ) && StockBytes( PL_defoutgv ) )
+		hv = EncodeHash( hv );
 
-	// Now call the perl sub and pass a ref to the HV as its arg
-	href = sv_2mortal( newRV( (SV *)hv ) );
+	    href = sv_2mortal( newRV( (SV *)hv ) );
+	}
+
+	FlushOutput();
+
+	// Now call the perl sub and pass the hash or record as its arg
+	PUSHMARK(SP);
 	XPUSHs( perlUI );
 	XPUSHs( href );
 	PUTBACK;
@@ -368,6 +486,90 @@ ClientUserPerl::OutputStat( StrDict *varList )
 void
 ClientUserPerl::OutputText( const_char *data, int length )
 {
+	SV	*sv;
+
+	if ( ( stock & UI_TEXT ) && StockText( data, length ) )
+	    return;
+
+	dTHX;
+
+	// The stock version should write what StockText() would have
+	if ( ! utf8 || ( ( stock & UI_TEXT ) && StockBytes( PL_defoutgv ) ) )
+	{
+	    CallOutputText( newSVpv( (char *)data, 0 ), length );
+	    return;
+	}
+
+	/*
+	 * Text comes in chunks which may split a multibyte character, so 
+	 * the end of one chunk may be held back to go with the next.
+	 */
+	if ( textTail.Length() )
+	{
+	    StrBuf	chunk;
+
+	    chunk.Set( textTail );
+	    chunk.Append( data, length );
+	    textTail.Clear();
+	    sv = NewText( chunk.Text(), chunk.Length() );
+	}
+	else
+	{
+	    sv = NewText( data, length );
+	}
+
+	// The length passed on is in characters, as that's what printf wants
+	if ( sv )
+	    CallOutputText( sv, sv_len_utf8( sv ) );
+}
+
+/*
+ * Make the string for a chunk of text in UTF-8 mode, keeping back any
+ * incomplete character at the end in textTail. Returns 0 if there's 
+ * nothing to send yet.
+ */
+SV *
+ClientUserPerl::NewText( const char *data, int length )
+{
+	int	tail;
+	int	status = Utf8Check::Scan( data, length, &tail );
+
+	if ( tail )
+	{
+	    textTail.Set( data + length - tail, tail );
+	    if ( ! ( length -= tail ) )
+		return 0;
+	}
+
+	return MakeString( data, length, status, utf8 );
+}
+
+/*
+ * Send out an incomplete character still held back from the last chunk
+ * of text. Called when the text is followed by something else, or not
+ * followed at all, so it's invalid and the Utf8Policy applies.
+ */
+void
+ClientUserPerl::FlushText()
+{
+	StrBuf	tail;
+
+	if ( ! textTail.Length() )
+	    return;
+
+	tail.Set( textTail );
+	textTail.Clear();
+
+	dTHX;
+	SV *sv = NewString( tail.Text(), tail.Length(), utf8 );
+	CallOutputText( sv, sv_len_utf8( sv ) );
+}
+
+void
+ClientUserPerl::CallOutputText( SV *sv, int length )
+{
+	FlushOutput();
+
 	dTHX;
 	dSP;
 	ENTER;
@@ -376,7 +578,7 @@ ClientUserPerl::OutputText( const_char *data, int length )
 
 	// Put args on stack
 	XPUSHs( perlUI );
-	XPUSHs( sv_2mortal( newSVpv( (char *)data, 0 ) ) );
+	XPUSHs( sv_2mortal( sv ) );
 	XPUSHs( sv_2mortal( newSViv( length ) ) );
 	PUTBACK;
 
@@ -392,6 +594,9 @@ ClientUserPerl::OutputText( const_char *data, int length )
 void
 ClientUserPerl::OutputBinary( const_char *data, int length )
 {
+	FlushText();
+	FlushOutput();
+
 	dTHX;
 	dSP;
 	ENTER;
@@ -424,6 +629,8 @@ ClientUserPerl::Prompt( const StrPtr &msg, StrBuf &rsp,
 {
 	int 	n;
 
+	FlushOutput();
+
 	if ( noEcho )
 	{
 	    ClientUser::Prompt( msg, rsp, noEcho, e );
@@ -438,7 +645,7 @@ ClientUserPerl::Prompt( const StrPtr &msg, StrBuf &rsp,
 
 	// Put args on stack
 	XPUSHs( perlUI );
-	XPUSHs( sv_2mortal( newSVpv( msg.Text(), msg.Length() ) ) );
+	XPUSHs( sv_2mortal( NewString( msg.Text(), msg.Length(), utf8 ) ) );
 	PUTBACK;
 
 	n = PERL_CALL_METHOD( "Prompt", G_SCALAR );
@@ -454,6 +661,46 @@ ClientUserPerl::Prompt( const StrPtr &msg, StrBuf &rsp,
 }
 
 
+/*
+ * Progress report from P4::Client::ParallelSync(). Called periodically
+ * on the Perl thread while the shards are syncing, so it's called in an
+ * eval: a die mustn't unwind past the caller while its threads are still
+ * running. Returns false if it died, leaving the error in $@.
+ */
+int
+ClientUserPerl::SyncProgress( int files, int totalFiles,
+			      double bytes, double totalBytes )
+{
+	int	ok;
+
+	FlushOutput();
+
+	dTHX;
+	dSP;
+	ENTER;
+	SAVETMPS;
+	PUSHMARK(SP);
+
+	XPUSHs( perlUI );
+	XPUSHs( sv_2mortal( newSViv( files ) ) );
+	XPUSHs( sv_2mortal( newSViv( totalFiles ) ) );
+	XPUSHs( sv_2mortal( newSVnv( bytes ) ) );
+	XPUSHs( sv_2mortal( newSVnv( totalBytes ) ) );
+	PUTBACK;
+
+	PERL_CALL_METHOD( "SyncProgress", G_VOID | G_EVAL );
+	ok = ! SvTRUE( ERRSV );
+
+	// Clean up stack for return
+	SPAGAIN;
+	PUTBACK;
+	FREETMPS;
+	LEAVE;
+
+	return ok;
+}
+
+
 /*
  * Support for capturing the output of "p4 diff". Since the Diff class only
  * supports writing its output to a FILE object, we write it to a temp file,
@@ -473,6 +720,8 @@ ClientUserPerl::Diff( FileSys *f1, FileSys *f2, int doPage,
 
 	if ( perlDiffs )
 	{
+	    FlushOutput();
+
 	    dTHX;
 	    dSP;
 	    ENTER;
@@ -557,27 +806,47 @@ ClientUserPerl::Diff( FileSys *f1, FileSys *f2, int doPage,
 }
 
 
+/*
+ * Returns true if the variable var goes to make up the hash key named
+ * key: that is if its base name (see SplitKey()) is key, or is key 
+ * without a trailing "s" (see InsertItem()).
+ */
+
+static int
+BaseOf( const StrPtr *key, const StrPtr *var )
+{
+    int i;
+    int len = key->Length();
+
+    for ( i = var->Length(); i; i-- )
+    {
+	char prev = (*var)[ i-1 ];
+	if ( !isdigit( prev ) && prev != ',' )
+	    break;
+    }
+    if ( ! i ) i = var->Length();
+
+    if ( i == len )
+	return ! memcmp( var->Text(), key->Text(), i );
+
+    return i == len - 1 && (*key)[ i ] == 's' &&
+	   ! memcmp( var->Text(), key->Text(), i );
+}
+
 /*
  * Convert a dictionary to a hash. Numbered elements are converted
  * into an array member of the hash.
  */
 
 void
-ClientUserPerl::DictToHash( StrDict *d, HV *hv )
+ClientUserPerl::DictToHash( StrDict *d, HV *hv, P4Trace *trace, int utf8 )
 {
-    AV		*av = 0;
-    SV		*rv = 0;
-    SV		**svp = 0;
-    int		i;
-    int		seq;
-    StrBuf	key;
     StrRef	var, val;
-    StrPtr	*data = d->GetVar( "data" );
 
-    for( i = 0; d->GetVar( i, var, val ); i++ )
+    for( int i = 0; d->GetVar( i, var, val ); i++ )
     {
 	if( var == "func" ) continue;
-	InsertItem( hv, &var, &val );
+	InsertItem( hv, &var, &val, trace, utf8 );
     }
 }
 
@@ -613,22 +882,17 @@ ClientUserPerl::SplitKey( const StrPtr *key, StrBuf &base, StrBuf &index )
  */
 
 void
-ClientUserPerl::InsertItem( HV *hv, const StrPtr *var, const StrPtr *val )
+ClientUserPerl::InsertItem( HV *hv, const StrPtr *var, const StrPtr *val,
+			    P4Trace *trace, int utf8 )
 {
     SV		**svp = 0;
     AV		*av = 0;
     StrBuf	base, index;
-    StrRef	comma( "," );
 
-    if ( debug )
-	printf( "\tInserting key %s, value %s \n", var->Text(), val->Text() );
+    P4TRACE( trace, TR_STAT, 2, "insert", var->Text(), val->Length() );
 
     SplitKey( var, base, index );
 
-    if ( debug )
-	printf( "\t\tbase=%s, index=%s\n", base.Text(), index.Text() );
-
-
     // If there's no index, then we insert into the top level hash 
     // but if the key is already defined then we need to rename the key. This
     // is probably one of those special keys like otherOpen which can be
@@ -637,28 +901,27 @@ ClientUserPerl::InsertItem( HV *hv, const StrPtr *var, const StrPtr *val )
     // value
     if ( index == "" )
     {
-	svp = hv_fetch( hv, base.Text(), base.Length(), 0 );
+	svp = hv_fetch( hv, base.Text(), KeyLength( &base, utf8 ), 0 );
 	if ( svp )
 	    base.Append( "s" );
 
-	if ( debug )
-	    printf( "\tCreating new scalar hash member %s\n", base.Text() );
-	hv_store( hv, base.Text(), base.Length(), 
-	     newSVpv( val->Text(), val->Length() ), 0 );
+	P4TRACE( trace, TR_STAT, 3, "new scalar", base.Text(), -1 );
+	hv_store( hv, base.Text(), KeyLength( &base, utf8 ), 
+	     NewString( val->Text(), val->Length(), utf8 ), 0 );
 	return;
     }
 
     //
     // Get or create the parent AV from the hash.
     //
-    svp = hv_fetch( hv, base.Text(), base.Length(), 0 );
+    svp = hv_fetch( hv, base.Text(), KeyLength( &base, utf8 ), 0 );
     if ( ! svp ) 
     {
-	if ( debug )
-	    printf( "\tCreating new array hash member %s\n", base.Text() );
+	P4TRACE( trace, TR_STAT, 3, "new array", base.Text(), -1 );
 
 	av = newAV();
-	hv_store( hv, base.Text(), base.Length(), newRV( (SV*)av) ,0 );
+	hv_store( hv, base.Text(), KeyLength( &base, utf8 ), 
+		  newRV( (SV*)av) ,0 );
     }
 
     if ( svp && ! SvROK( *svp ) )
@@ -674,12 +937,24 @@ ClientUserPerl::InsertItem( HV *hv, const StrPtr *var, const StrPtr *val )
     if ( svp && SvROK( *svp ) )
 	av = (AV *) SvRV( *svp );
 
+    InsertIndexed( av, index, val, trace, utf8 );
+}
+
+/*
+ * Insert an element into the array for a numbered variable, given the
+ * index part of its name.
+ */
+
+void
+ClientUserPerl::InsertIndexed( AV *av, StrBuf &index, const StrPtr *val,
+			       P4Trace *trace, int utf8 )
+{
+    SV		**svp = 0;
+    StrRef	comma( "," );
+
     // The index may be a simple digit, or it could be a comma separated
     // list of digits. For each "level" in the index, we need a containing
     // AV and an HV inside it.
-    if ( debug )
-	printf( "\tFinding correct index level...\n" );
-
     for( const char *c = 0 ; c = index.Contains( comma ); )
     {
 	StrBuf	level;
@@ -690,8 +965,8 @@ ClientUserPerl::InsertItem( HV *hv, const StrPtr *var, const StrPtr *val )
 	// under the current av. If the level is "0", then we create a new
 	// one, otherwise we just pop the most recent AV off the parent
 	
-	if ( debug )
-	    printf( "\t\tgoing down...\n" );
+	P4TRACE( trace, TR_STAT, 3, "nested level", index.Text(), 
+			level.Atoi() );
 
 	svp = av_fetch( av, level.Atoi(), 0 );
 	if ( ! svp )
@@ -717,40 +992,153 @@ ClientUserPerl::InsertItem( HV *hv, const StrPtr *var, const StrPtr *val )
 	    av = (AV *) SvRV( *svp );
 	}
     }
-    if ( debug )
-	printf( "\tInserting value %s\n", val->Text() );
+    av_push( av, NewString( val->Text(), val->Length(), utf8 ) );
+}
+
+/*
+ * The value DictToHash() would store under key, built without the rest
+ * of the hash: used by P4::Client::Record::Get(). Follows InsertItem()
+ * in renaming a scalar to key + "s" if key is already taken. Returns 0
+ * if there'd be no such key.
+ */
+
+SV *
+ClientUserPerl::HashValue( StrDict *d, const StrPtr *key, int utf8 )
+{
+    dTHX;
+    SV		*result = 0;
+    int		haveSingular = 0;
+    StrBuf	base, index;
+    StrRef	var, val;
+
+    for ( int i = 0; d->GetVar( i, var, val ); i++ )
+    {
+	if ( var == "func" || ! BaseOf( key, &var ) ) 
+	    continue;
+
+	SplitKey( &var, base, index );
 
-    av_push( av, newSVpv( val->Text(), 0 ) );
+	if ( base != *key )
+	{
+	    // A variable named key without its "s". Its scalar only 
+	    // lands on key if the shorter name is already in the hash.
+	    if ( index == "" && haveSingular )
+	    {
+		if ( result ) SvREFCNT_dec( result );
+		result = NewString( val.Text(), val.Length(), utf8 );
+	    }
+	    haveSingular = 1;
+	}
+	else if ( index == "" )
+	{
+	    if ( ! result )
+		result = NewString( val.Text(), val.Length(), utf8 );
+	}
+	else
+	{
+	    if ( result && ! SvROK( result ) )
+	    {
+		StrBuf	msg;
+		msg << "Key (" << base << ") not a reference!";
+		warn( msg.Text() );
+		continue;
+	    }
+	    if ( ! result )
+		result = newRV_noinc( (SV *)newAV() );
+	    InsertIndexed( (AV *)SvRV( result ), index, &val, 0, utf8 );
+	}
+    }
+    return result;
 }
 
+/*
+ * Make a new SV from a string sent by the server. With a Utf8Policy 
+ * other than UTF8_OFF, valid UTF-8 is flagged as such and invalid 
+ * strings are dealt with according to the policy. 7-bit strings mean 
+ * the same either way, and are left unflagged.
+ */
 
-void
-ClientUserPerl::HashToForm( HV *hv, StrBuf *b )
+SV *
+ClientUserPerl::NewString( const char *p, int len, int utf8 )
 {
-    HV		*flatHv = 0;
-    StrPtr	*specdef = 0;
+    dTHX;
+
+    if ( ! utf8 )
+	return newSVpv( (char *)p, len );
+
+    return MakeString( p, len, Utf8Check::Scan( p, len ), utf8 );
+}
 
-    if ( debug )
-	printf( "HashToForm: Converting hash input into a form.\n" );
+SV *
+ClientUserPerl::MakeString( const char *p, int len, int status, int utf8 )
+{
+    dTHX;
+    SV		*sv;
+    StrBuf	fixed;
 
-    specdef = varList->GetVar( "specdef" );
+    if ( status == UTF8_ASCII || 
+	 ( status == UTF8_INVALID && utf8 == UTF8_BYTES ) )
+	return newSVpvn( p, len );
+
+    if ( status == UTF8_INVALID )
+    {
+	Utf8Check::Repair( p, len, fixed, utf8 );
+	sv = newSVpvn( fixed.Text(), fixed.Length() );
+    }
+    else
+    {
+	sv = newSVpvn( p, len );
+    }
+
+    SvUTF8_on( sv );
+    return sv;
+}
+
+/*
+ * The length to give hv_store() and friends for a key: negative for a
+ * UTF-8 key. Keys which aren't valid UTF-8 are always left as bytes.
+ */
+
+I32
+ClientUserPerl::KeyLength( const StrPtr *key, int utf8 )
+{
+    if ( utf8 && Utf8Check::Scan( key->Text(), key->Length() ) == UTF8_VALID )
+	return -(I32)key->Length();
+
+    return key->Length();
+}
+
+
+/*
+ * Format a hash into a form using an already parsed spec. Static so that
+ * ApplyForms() can format a whole batch against one spec. Returns false
+ * if the hash can't be converted, having warned or, if err is given,
+ * having put the reason in err instead.
+ */
+
+int
+ClientUserPerl::HashToForm( HV *hv, Spec *s, StrBuf *b, P4Trace *trace,
+			    StrBuf *err )
+{
+    HV		*flatHv = 0;
+
+    P4TRACE( trace, TR_FORM, 1, "HashToForm", 0, HvKEYS( hv ) );
 
     /*
      * Also need now to go through the hash looking for AV elements
      * as they need to be flattened before parsing. Yuk!
      */
-    if ( ! ( flatHv = FlattenHash( hv ) ) )
+    if ( ! ( flatHv = FlattenHash( hv, trace, err ) ) )
     {
-	warn( "Failed to convert Perl hash to Perforce form");
-	return;
+	if ( ! err )
+	    warn( "Failed to convert Perl hash to Perforce form");
+	return 0;
     }
 
 
-    if ( debug )
-	printf( "HashToForm: Flattened hash input.\n" );
+    P4TRACE( trace, TR_FORM, 1, "flattened hash", 0, HvKEYS( flatHv ) );
 
     SpecDataTable	specData;
-    Spec		s( specdef->Text(), "" );
 
     char	*key;
     SV		*val;
@@ -762,25 +1150,24 @@ ClientUserPerl::HashToForm( HV *hv, StrBuf *b )
 	specData.Dict()->SetVar( key, SvPV( val, PL_na ) );
     }
 
-    s.Format( &specData, b );
-
-    if ( debug )
-	printf( "HashToForm: Form looks like this\n%s\n", b->Text() );
+    s->Format( &specData, b );
 
+    P4TRACE( trace, TR_FORM, 1, "formatted form", 0, b->Length() );
+    return 1;
 }
 
 // Flatten array elements in a hash into something Perforce can parse.
+// Failures are warned about, or put in err if it's given.
 
 HV * 
-ClientUserPerl::FlattenHash( HV *hv )
+ClientUserPerl::FlattenHash( HV *hv, P4Trace *trace, StrBuf *err )
 {
     HV 		*fl;
     SV		*val;
     char	*key;
     I32		klen;
 
-    if ( debug )
-	printf( "FlattenHash: Flattening hash contents\n" );
+    P4TRACE( trace, TR_FORM, 1, "FlattenHash", 0, HvKEYS( hv ) );
 
     fl = (HV *)sv_2mortal( (SV *)newHV() );
     for ( hv_iterinit( hv ); val = hv_iternextsv( hv, &key, &klen ); )
@@ -797,14 +1184,14 @@ ClientUserPerl::FlattenHash( HV *hv )
 			"Perforce forms may not contain Perl objects. " 
 			"Permitted types are strings, numbers and arrays";
 
-		warn( msg.Text() );
+		if ( err ) err->Set( msg );
+		else warn( msg.Text() );
 		return NULL;
 	    }
 
 	    if ( SvTYPE( SvRV( val ) ) == SVt_PVAV ) 
 	    {
-		if ( debug )
-		    printf( "FlattenHash: Flattening %s array\n", key );
+		P4TRACE( trace, TR_FORM, 2, "flatten array", key, -1 );
 
 		// Flatten this array by constructing keys from the parent
 		// hash key and the array index
@@ -813,9 +1200,6 @@ ClientUserPerl::FlattenHash( HV *hv )
 		{
 		    StrBuf	newKey;
 
-		    if ( debug )
-			printf( "Parsing element %d\n", i );
-
 		    SV	**elem = av_fetch( av, i, 0 );
 
 		    if ( ! elem )
@@ -825,33 +1209,24 @@ ClientUserPerl::FlattenHash( HV *hv )
 			       "Array elements may only contain strings " <<
 			       "and numbers.";
 
-			warn( msg.Text() );
+			if ( err ) err->Set( msg );
+			else warn( msg.Text() );
 			return NULL;
 		    }
 
-		    if ( debug )
-			printf( "Fetched element %d\n", i );
-
 		    newKey.Set( key );
 		    newKey << i;
 
-		    if ( debug )
-			printf( "Formatted element %d( %s )\n", i, newKey.Text() );
-
+		    P4TRACE( trace, TR_FORM, 3, "element", newKey.Text(), i );
 
 		    hv_store( fl, newKey.Text(), newKey.Length(), 
 			    SvREFCNT_inc(*elem), 0 );
-
-		    if ( debug )
-			printf( "Stored element %d\n", i );
-
 		}
 	    }
 	}
 	else
 	{
-	    if ( debug )
-		printf( "FlattenHash: Found non-array member %s\n", key );
+	    P4TRACE( trace, TR_FORM, 2, "scalar", key, -1 );
 
 	    // Just store the element as is
 	    hv_store( fl, key, klen, SvREFCNT_inc(val), 0 );
@@ -859,3 +1234,439 @@ ClientUserPerl::FlattenHash( HV *hv )
     }
     return fl;
 }
+
+
+/*******************************************************************************
+ * Native versions of the stock P4::UI output methods. Most scripts use a
+ * plain P4::UI object just to get p4-style output, so when the UI object 
+ * hasn't overridden a method we produce exactly what the Perl version 
+ * would have printed here, and save a Perl method call per line. Anything
+ * we can't reproduce byte for byte goes through Perl as before.
+ ******************************************************************************/
+
+/*
+ * Works out which of the output methods of the UI object are the ones
+ * in UI.pm, returning a mask of UI_* flags.
+ */
+int
+ClientUserPerl::StockMethods()
+{
+	static const char *names[] = 
+	{ "OutputInfo", "OutputError", "OutputStat", "OutputText", 0 };
+
+	HV	*stash;
+	HV	*base;
+	int	mask = 0;
+
+	dTHX;
+	if ( ! SvROK( perlUI ) || ! SvOBJECT( SvRV( perlUI ) ) )
+	    return 0;
+
+	stash = SvSTASH( SvRV( perlUI ) );
+	if ( ! ( base = gv_stashpv( "P4::UI", 0 ) ) )
+	    return 0;
+
+	for ( int i = 0; names[ i ]; i++ )
+	{
+	    GV	*mine = gv_fetchmethod_autoload( stash, names[ i ], FALSE );
+	    GV	*orig = gv_fetchmethod_autoload( base, names[ i ], FALSE );
+
+	    if ( ! mine || ! orig || GvCV( mine ) != GvCV( orig ) ) 
+		continue;
+
+#ifdef CvFILE
+	    // Make sure nobody has redefined the method in P4::UI itself
+	    const char	*file = CvFILE( GvCV( orig ) );
+	    int		len = file ? strlen( file ) : 0;
+
+	    if ( len < 5 || strcmp( file + len - 5, "UI.pm" ) )
+		continue;
+#endif
+	    mask |= 1 << i;
+	}
+	return mask;
+}
+
+/*
+ * Returns the PerlIO handle that print() would write to through the
+ * given glob, or NULL if print() would do anything more than write the
+ * bytes we give it: the handle is tied, closed or has a :utf8 layer, or 
+ * $, or $\ are set.
+ */
+PerlIO *
+ClientUserPerl::StockHandle( GV *gv )
+{
+	IO	*io;
+	PerlIO	*fp;
+	SV	*sv;
+
+	dTHX;
+	if ( ! gv || ! ( io = GvIOp( gv ) ) || ! ( fp = IoOFP( io ) ) )
+	    return 0;
+
+	if ( SvRMAGICAL( io ) && mg_find( (SV *)io, 'q' ) )
+	    return 0;
+
+#if PERL_REVISION == 5 && PERL_VERSION >= 8
+	if ( PerlIO_isutf8( fp ) )
+	    return 0;
+#endif
+
+	if ( ( sv = get_sv( ",", FALSE ) ) )
+	{
+	    SvGETMAGIC( sv );
+	    if ( SvOK( sv ) ) return 0;
+	}
+	if ( ( sv = get_sv( "\\", FALSE ) ) )
+	{
+	    SvGETMAGIC( sv );
+	    if ( SvOK( sv ) ) return 0;
+	}
+
+	autoFlush = IoFLAGS( io ) & IOf_FLUSH;
+	return fp;
+}
+
+/*
+ * When a stock method has to be left to P4::UI after all, whether it 
+ * should be given UTF-8 bytes rather than character strings so that it
+ * writes what the native version would have. Not if the handle has a
+ * :utf8 layer, which would encode them a second time.
+ */
+int
+ClientUserPerl::StockBytes( GV *gv )
+{
+	if ( ! utf8 )
+	    return 0;
+
+#if PERL_REVISION == 5 && PERL_VERSION >= 8
+	IO	*io;
+	PerlIO	*fp;
+
+	dTHX;
+	if ( gv && ( io = GvIOp( gv ) ) && ( fp = IoOFP( io ) ) &&
+	     PerlIO_isutf8( fp ) )
+	    return 0;
+#endif
+
+	return 1;
+}
+
+/*
+ * Buffer output for a PerlIO handle. Switching handles flushes the
+ * output for the previous one first so that the order is preserved.
+ */
+void
+ClientUserPerl::Write( PerlIO *fp, const char *data, int length )
+{
+	if ( fp != outFp )
+	{
+	    FlushOutput();
+	    outFp = fp;
+	}
+
+	outBuf.Append( data, length );
+	if ( outBuf.Length() >= OUTBUF_SIZE )
+	    FlushOutput();
+}
+
+/*
+ * Hands whatever we've buffered to PerlIO. This must be called before 
+ * anything that might call into Perl.
+ */
+void
+ClientUserPerl::FlushOutput()
+{
+	if ( outFp && outBuf.Length() )
+	{
+	    dTHX;
+	    PerlIO_write( outFp, outBuf.Text(), outBuf.Length() );
+	    if ( autoFlush )
+		PerlIO_flush( outFp );
+	}
+	outBuf.Clear();
+}
+
+/*
+ * P4::UI::OutputInfo()
+ */
+int
+ClientUserPerl::StockInfo( int level, const char *data )
+{
+	PerlIO	*fp;
+
+	dTHX;
+	if ( ! ( fp = StockHandle( PL_defoutgv ) ) )
+	    return 0;
+
+	for ( ; level > 0; level-- )
+	    Write( fp, ".... ", 5 );
+
+	Write( fp, data, strlen( data ) );
+	Write( fp, "\n", 1 );
+
+	if ( autoFlush ) FlushOutput();
+	return 1;
+}
+
+/*
+ * P4::UI::OutputError(). STDERR is unbuffered, so write it straight out.
+ */
+int
+ClientUserPerl::StockError( const char *data, int length )
+{
+	PerlIO	*fp;
+
+	dTHX;
+	if ( ! ( fp = StockHandle( gv_fetchpv( "STDERR", FALSE, SVt_PVIO ) ) ) )
+	    return 0;
+
+	Write( fp, data, length );
+	FlushOutput();
+	return 1;
+}
+
+/*
+ * P4::UI::OutputText() does printf( "%*s", $len, $text ), and the text
+ * is passed as a C string, so it's right justified in a field of $len.
+ */
+int
+ClientUserPerl::StockText( const char *data, int length )
+{
+	PerlIO	*fp;
+	int	len = strlen( data );
+
+	dTHX;
+	if ( ! ( fp = StockHandle( PL_defoutgv ) ) )
+	    return 0;
+
+	for ( ; length > len; length-- )
+	    Write( fp, " ", 1 );
+
+	Write( fp, data, len );
+
+	if ( autoFlush ) FlushOutput();
+	return 1;
+}
+
+/*
+ * The next character of a hash key, which is either UTF-8 or Latin-1.
+ */
+static unsigned int
+NextChar( const unsigned char *&p, const unsigned char *e, int utf8 )
+{
+	unsigned int	c = *p++;
+	int		more = 0;
+
+	if ( ! utf8 || c < 0xc0 )
+	    return c;
+
+	if ( c < 0xe0 ) 	{ c &= 0x1f; more = 1; }
+	else if ( c < 0xf0 )	{ c &= 0x0f; more = 2; }
+	else			{ c &= 0x07; more = 3; }
+
+	for ( ; more && p < e; more-- )
+	    c = ( c << 6 ) | ( *p++ & 0x3f );
+	return c;
+}
+
+/*
+ * Perl's default sort order: by character, so a key that Perl stored 
+ * downgraded to Latin-1 still sorts where its UTF-8 form would.
+ */
+static int
+CompareKeys( const void *a, const void *b )
+{
+	HEK	*ka = HeKEY_hek( *(HE **)a );
+	HEK	*kb = HeKEY_hek( *(HE **)b );
+	int	la = HEK_LEN( ka );
+	int	lb = HEK_LEN( kb );
+
+	if ( ! HEK_UTF8( ka ) && ! HEK_UTF8( kb ) )
+	{
+	    int	r = memcmp( HEK_KEY( ka ), HEK_KEY( kb ), la < lb ? la : lb );
+	    return r ? r : la - lb;
+	}
+
+	const unsigned char *pa = (const unsigned char *)HEK_KEY( ka );
+	const unsigned char *pb = (const unsigned char *)HEK_KEY( kb );
+	const unsigned char *ea = pa + la;
+	const unsigned char *eb = pb + lb;
+
+	while ( pa < ea && pb < eb )
+	{
+	    unsigned int ca = NextChar( pa, ea, HEK_UTF8( ka ) );
+	    unsigned int cb = NextChar( pb, eb, HEK_UTF8( kb ) );
+
+	    if ( ca != cb )
+		return ca < cb ? -1 : 1;
+	}
+	return ( pa < ea ) - ( pb < eb );
+}
+
+/*
+ * A copy of a tagged output hash with its character strings, keys and 
+ * array members included, encoded as UTF-8 bytes. Anything StockStat() 
+ * wouldn't have printed is copied as it is.
+ */
+static SV *
+EncodeValue( SV *sv )
+{
+	dTHX;
+	SV	*copy = newSVsv( sv );
+
+	if ( SvUTF8( copy ) )
+	    sv_utf8_encode( copy );
+	return copy;
+}
+
+HV *
+ClientUserPerl::EncodeHash( HV *hv )
+{
+	HV	*copy = newHV();
+	HE	*he;
+	STRLEN	len;
+
+	dTHX;
+	sv_2mortal( (SV *)copy );
+
+	hv_iterinit( hv );
+	while ( ( he = hv_iternext( hv ) ) )
+	{
+	    SV		*val = HeVAL( he );
+	    const char	*key;
+
+	    if ( HeKLEN( he ) == HEf_SVKEY || HeKUTF8( he ) || 
+		 HeKWASUTF8( he ) )
+	    {
+		key = SvPVutf8( HeSVKEY_force( he ), len );
+	    }
+	    else
+	    {
+		key = HeKEY( he );
+		len = HeKLEN( he );
+	    }
+
+	    if ( SvROK( val ) && SvTYPE( SvRV( val ) ) == SVt_PVAV )
+	    {
+		AV	*av = (AV *)SvRV( val );
+		AV	*items = newAV();
+
+		for ( I32 i = 0; i <= av_len( av ); i++ )
+		{
+		    SV	**item = av_fetch( av, i, 0 );
+		    if ( item )
+			av_store( items, i, EncodeValue( *item ) );
+		}
+		val = newRV_noinc( (SV *)items );
+	    }
+	    else
+	    {
+		val = EncodeValue( val );
+	    }
+
+	    hv_store( copy, key, len, val, 0 );
+	}
+	return copy;
+}
+
+/*
+ * P4::UI::OutputStat(). Keys are printed in sorted order, array members
+ * one per line beneath their key. Anything that Perl would have 
+ * stringified or warned about (nested arrays, undefined elements) is 
+ * left to the Perl version. Character strings from Utf8Mode() are 
+ * written as UTF-8, as the stock info, error and text output is.
+ */
+int
+ClientUserPerl::StockStat( HV *hv )
+{
+	PerlIO	*fp;
+	HE	**ents;
+	HE	*he;
+	I32	n = 0;
+	int	ok = 1;
+	STRLEN	len;
+
+	dTHX;
+	if ( ! ( fp = StockHandle( PL_defoutgv ) ) )
+	    return 0;
+
+	ents = new HE *[ HvKEYS( hv ) + 1 ];
+
+	hv_iterinit( hv );
+	while ( ok && ( he = hv_iternext( hv ) ) )
+	{
+	    SV	*val = HeVAL( he );
+
+	    ents[ n++ ] = he;
+
+	    if ( HeKLEN( he ) == HEf_SVKEY )
+		ok = 0;
+	    else if ( ! SvROK( val ) )
+		ok = SvOK( val );
+	    else if ( SvTYPE( SvRV( val ) ) != SVt_PVAV )
+		ok = 0;
+	    else
+	    {
+		AV	*av = (AV *)SvRV( val );
+
+		for ( I32 i = 0; ok && i <= av_len( av ); i++ )
+		{
+		    SV	**item = av_fetch( av, i, 0 );
+		    ok = item && SvOK( *item ) && ! SvROK( *item );
+		}
+	    }
+	}
+
+	if ( ! ok )
+	{
+	    delete [] ents;
+	    return 0;
+	}
+
+	qsort( ents, n, sizeof( HE * ), CompareKeys );
+
+	for ( I32 i = 0; i < n; i++ )
+	{
+	    SV		*val = HeVAL( ents[ i ] );
+	    const char	*s;
+
+	    Write( fp, "... ", 4 );
+	    if ( HeKUTF8( ents[ i ] ) || HeKWASUTF8( ents[ i ] ) )
+	    {
+		// Keys that were stored downgraded need upgrading again
+		s = SvPVutf8( HeSVKEY_force( ents[ i ] ), len );
+		Write( fp, s, len );
+	    }
+	    else
+		Write( fp, HeKEY( ents[ i ] ), HeKLEN( ents[ i ] ) );
+
+	    if ( ! SvROK( val ) )
+	    {
+		s = SvUTF8( val ) ? SvPVutf8( val, len ) : SvPV( val, len );
+		Write( fp, " ", 1 );
+		Write( fp, s, len );
+		Write( fp, "\n", 1 );
+		continue;
+	    }
+
+	    Write( fp, "\n", 1 );
+
+	    AV	*av = (AV *)SvRV( val );
+	    for ( I32 j = 0; j <= av_len( av ); j++ )
+	    {
+		SV	*item = *av_fetch( av, j, 0 );
+
+		s = SvUTF8( item ) ? SvPVutf8( item, len ) : SvPV( item, len );
+		Write( fp, "... ... ", 8 );
+		Write( fp, s, len );
+		Write( fp, "\n", 1 );
+	    }
+	}
+	Write( fp, "\n", 1 );
+
+	delete [] ents;
+
+	if ( autoFlush ) FlushOutput();
+	return 1;
+}
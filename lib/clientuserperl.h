@@ -29,10 +29,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * Defines the ClientUser derived class used by the perl interface
  */
 
+class HaveIndex;
+class P4Trace;
+class Aggregate;
+class Spec;
+
 class ClientUserPerl : public ClientUser
 {
     public:
 			ClientUserPerl( SV * perlUI );
+			~ClientUserPerl();
 
 	virtual void	ErrorPause( char *errBuf, Error *e );
 	virtual void 	HandleError( Error *err );
@@ -48,20 +54,77 @@ class ClientUserPerl : public ClientUser
 	virtual void	Diff( FileSys *f1, FileSys *f2, int doPage,
 	       			char *diffFlags, Error *e );
 
-		void	DebugLevel( int d ) { debug = d; }
+		int	SyncProgress( int files, int totalFiles,
+				      double bytes, double totalBytes );
+
+		void	SetTrace( P4Trace *t )	{ trace = t; }
 		void	DoPerlDiffs( int flag )	{ perlDiffs = flag; }
+		void	LazyRecords( int flag )	{ lazy = flag; }
+		void	Utf8Mode( int policy )	{ utf8 = policy; }
+		void	SetAggregate( Aggregate *a )	{ aggregate = a; }
+		void	SetHaveIndex( HaveIndex *i, const char *cmd )
+			    { haveIndex = i; command.Set( cmd ); }
+
+		// Also used by P4::Client::Record
+	static	void 	DictToHash( StrDict *d, HV *hv, P4Trace *trace = 0,
+				    int utf8 = 0 );
+	static	void	SplitKey( const StrPtr *key, StrBuf &base, StrBuf &index );
+	static	SV *	HashValue( StrDict *d, const StrPtr *key, int utf8 = 0 );
+
+		// Strings and hash key lengths for a Utf8Policy
+	static	SV *	NewString( const char *p, int len, int utf8 );
+	static	I32	KeyLength( const StrPtr *key, int utf8 );
+
+		// Also used by ApplyForms()
+	static	int	HashToForm( HV *hv, Spec *s, StrBuf *b, 
+				    P4Trace *trace = 0, StrBuf *err = 0 );
 
     private:
-		void 	DictToHash( StrDict *d, HV *hv );
-		void	SplitKey( const StrPtr *key, StrBuf &base, StrBuf &index );
-		void	InsertItem( HV *hv, const StrPtr *var, const StrPtr *val );
-		void	HashToForm( HV *hv, StrBuf *b );
-		HV *	FlattenHash( HV *hv );
+	static	void	InsertItem( HV *hv, const StrPtr *var, const StrPtr *val,
+				    P4Trace *trace, int utf8 );
+	static	void	InsertIndexed( AV *av, StrBuf &index, const StrPtr *val,
+				       P4Trace *trace, int utf8 );
+	static	SV *	MakeString( const char *p, int len, int status, 
+				    int utf8 );
+
+		SV *	NewText( const char *data, int length );
+		void	CallOutputText( SV *sv, int length );
+		void	FlushText();
+	static	HV *	FlattenHash( HV *hv, P4Trace *trace, StrBuf *err );
+
+		// Native versions of the stock P4::UI output methods
+		enum { 
+		    UI_INFO	= 0x01,
+		    UI_ERROR	= 0x02,
+		    UI_STAT	= 0x04,
+		    UI_TEXT	= 0x08
+		};
+
+		int	StockMethods();
+		PerlIO *StockHandle( GV *gv );
+		int	StockBytes( GV *gv );
+	static	HV *	EncodeHash( HV *hv );
+		int	StockInfo( int level, const char *data );
+		int	StockError( const char *data, int length );
+		int	StockStat( HV *hv );
+		int	StockText( const char *data, int length );
+		void	Write( PerlIO *fp, const char *data, int length );
+		void	FlushOutput();
 
     private:
 	SV*		perlUI;
-	int		debug;
+	P4Trace		*trace;
 	int		perlDiffs;
+	int		lazy;
+	int		utf8;
+	StrBuf		textTail;
+	HaveIndex	*haveIndex;
+	Aggregate	*aggregate;
+	StrBuf		command;
+	int		stock;
+	StrBuf		outBuf;
+	PerlIO		*outFp;
+	int		autoFlush;
 
 };
 
@@ -0,0 +1,463 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "p4thread.h"
+#include "p4connect.h"
+#include "conncache.h"
+
+/*
+ * Idle connections kept per set of settings
+ */
+#define CACHE_MAX_IDLE	4
+
+struct CacheEntry
+{
+	StrBuf		key;
+	ClientApi	*client;
+};
+
+static CacheEntry	**idle = 0;
+static int		nIdle = 0;
+static int		idleAlloc = 0;
+static P4Mutex		idleLock;
+
+/*
+ * Connections handed out by Get(), with the key they were made for, so
+ * they go back under that key even if the object's settings have since
+ * been changed.
+ */
+static CacheEntry	**busy = 0;
+static int		nBusy = 0;
+static int		busyAlloc = 0;
+
+/*
+ * Add an entry to one of the lists. Called with idleLock held.
+ */
+static void
+Push( CacheEntry ***list, int *n, int *alloc, CacheEntry *ce )
+{
+	if ( *n == *alloc )
+	{
+	    *alloc = *alloc ? *alloc * 2 : 16;
+	    *list = (CacheEntry **)realloc( *list, 
+	    			*alloc * sizeof( CacheEntry * ) );
+	}
+	(*list)[ (*n)++ ] = ce;
+}
+
+static int
+SameKey( const StrPtr &a, const StrPtr &b )
+{
+	return a.Length() == b.Length() && 
+	       ! memcmp( a.Text(), b.Text(), a.Length() );
+}
+
+/*
+ * The cache key. Protocol settings come from a Perl hash, so they're 
+ * sorted to make the key independent of the order they were set in.
+ */
+void
+ConnCache::Key( P4Settings *s, StrBuf &key )
+{
+	StrBuf	protocol[ 32 ];
+	StrRef	var, val;
+	int	n;
+
+	key.Clear();
+	key << s->port << "\n" << s->user << "\n" << s->client << "\n";
+	key << s->host << "\n" << s->password << "\n";
+
+	for ( n = 0; n < 32 && s->protocol.GetVar( n, var, val ); n++ )
+	{
+	    StrBuf	p;
+	    int		i;
+
+	    p << var << "=" << val;
+
+	    for ( i = n; i > 0 && strcmp( protocol[ i-1 ].Text(), p.Text() ) > 0;
+	    		i-- )
+		protocol[ i ] = protocol[ i-1 ];
+	    protocol[ i ] = p;
+	}
+
+	for ( int i = 0; i < n; i++ )
+	    key << protocol[ i ] << "\n";
+}
+
+/*
+ * Returns an initialised connection for the settings, reusing an idle
+ * one if there is one. Returns 0 and sets e if we can't connect.
+ */
+ClientApi *
+ConnCache::Get( P4Settings *s, Error *e )
+{
+	StrBuf		key;
+	ClientApi	*c = 0;
+
+	Key( s, key );
+
+	{
+	    P4Lock	lock( &idleLock );
+
+	    for ( int i = nIdle - 1; i >= 0 && ! c; i-- )
+	    {
+		CacheEntry *ce = idle[ i ];
+
+		if ( ! SameKey( ce->key, key ) )
+		    continue;
+
+		idle[ i ] = idle[ --nIdle ];
+		if ( ! ce->client->Dropped() )
+		    c = ce->client;
+		else
+		{
+		    Error	fe;
+		    ce->client->Final( &fe );
+		    delete ce->client;
+		}
+		delete ce;
+	    }
+	}
+
+	if ( c )
+	{
+	    if ( s->cwd.Length() ) 
+		c->SetCwd( &s->cwd );
+	}
+	else
+	{
+	    c = new ClientApi;
+	    if ( ! s->Connect( c, e ) )
+	    {
+		Error	fe;
+		c->Final( &fe );
+		delete c;
+		return 0;
+	    }
+	}
+
+	CacheEntry *ce = new CacheEntry;
+	ce->key.Set( key );
+	ce->client = c;
+
+	P4Lock	lock( &idleLock );
+	Push( &busy, &nBusy, &busyAlloc, ce );
+	return c;
+}
+
+/*
+ * Takes a connection's entry off the busy list, or returns 0 if it
+ * didn't come from Get(). Called with idleLock held.
+ */
+static CacheEntry *
+TakeBusy( ClientApi *c )
+{
+	for ( int i = 0; i < nBusy; i++ )
+	{
+	    if ( busy[ i ]->client != c )
+		continue;
+
+	    CacheEntry *ce = busy[ i ];
+	    busy[ i ] = busy[ --nBusy ];
+	    return ce;
+	}
+	return 0;
+}
+
+/*
+ * Gives a connection from Get() back to the cache under the key it was
+ * made for, or closes it if it's been dropped or the cache already has
+ * enough of them. Returns 0, leaving c alone, if it didn't come from 
+ * Get().
+ */
+int
+ConnCache::Release( ClientApi *c )
+{
+	CacheEntry	*ce = 0;
+	int		count = 0;
+
+	{
+	    P4Lock	lock( &idleLock );
+
+	    if ( ! ( ce = TakeBusy( c ) ) )
+		return 0;
+
+	    if ( ! c->Dropped() )
+	    {
+		for ( int i = 0; i < nIdle; i++ )
+		    if ( SameKey( idle[ i ]->key, ce->key ) )
+			count++;
+
+		if ( count < CACHE_MAX_IDLE )
+		{
+		    Push( &idle, &nIdle, &idleAlloc, ce );
+		    return 1;
+		}
+	    }
+	}
+
+	Error	e;
+	c->Final( &e );
+	delete c;
+	delete ce;
+	return 1;
+}
+
+/*
+ * Closes all the idle connections.
+ */
+void
+ConnCache::Flush()
+{
+	P4Lock	lock( &idleLock );
+
+	for ( int i = 0; i < nIdle; i++ )
+	{
+	    Error	e;
+
+	    idle[ i ]->client->Final( &e );
+	    delete idle[ i ]->client;
+	    delete idle[ i ];
+	}
+	nIdle = 0;
+}
+
+/*
+ * Commands which can safely be run again if the first attempt fails.
+ * Spec commands are only read-only with -o.
+ */
+int
+ConnCache::ReadOnly( const char *cmd, int argc, char **argv )
+{
+	static const char *reports[] = {
+	    "annotate", "branches", "changes", "changelists", "clients",
+	    "counters", "depots", "describe", "diff2", "dirs", "filelog",
+	    "files", "fixes", "fstat", "groups", "have", "info", "interchanges",
+	    "jobs", "labels", "opened", "print", "sizes", "users", "where",
+	    0
+	};
+	static const char *specs[] = {
+	    "branch", "change", "client", "depot", "group", "job", "label",
+	    "protect", "spec", "triggers", "typemap", "user", "workspace",
+	    0
+	};
+	int	i;
+
+	for ( i = 0; reports[ i ]; i++ )
+	    if ( ! strcmp( cmd, reports[ i ] ) )
+		return 1;
+
+	for ( i = 0; specs[ i ]; i++ )
+	    if ( ! strcmp( cmd, specs[ i ] ) )
+		break;
+
+	if ( ! specs[ i ] )
+	    return 0;
+
+	for ( i = 0; i < argc; i++ )
+	    if ( ! strcmp( argv[ i ], "-o" ) )
+		return 1;
+
+	return 0;
+}
+
+/*
+ * An error held back by RetryUser: either an Error for HandleError(), 
+ * or the text of one for OutputError().
+ */
+struct HeldError
+{
+	Error		err;
+	StrBuf		text;
+	int		isText;
+};
+
+/*
+ * Passes everything straight through to the real ClientUser, except
+ * that errors are held back until there's been some other output. If
+ * there hasn't, the command can still be retried without the user 
+ * seeing anything twice.
+ */
+class RetryUser : public ClientUser
+{
+    public:
+			RetryUser( ClientUser *ui ) { this->ui = ui; output = 0; }
+			~RetryUser() { Clear(); }
+
+	virtual void	ErrorPause( char *errBuf, Error *e )
+			    { Output(); ui->ErrorPause( errBuf, e ); }
+	virtual void 	HandleError( Error *err );
+	virtual void	InputData( StrBuf *strbuf, Error *e )
+			    { Output(); ui->InputData( strbuf, e ); }
+	virtual void 	OutputError( const_char *errBuf );
+	virtual void	OutputInfo( char level, const_char *data )
+			    { Output(); ui->OutputInfo( level, data ); }
+	virtual void	OutputStat( StrDict *varList )
+			    { Output(); ui->OutputStat( varList ); }
+	virtual void 	OutputText( const_char *data, int length )
+			    { Output(); ui->OutputText( data, length ); }
+	virtual void 	OutputBinary( const_char *data, int length )
+			    { Output(); ui->OutputBinary( data, length ); }
+	virtual void	Prompt( const StrPtr &msg, StrBuf &rsp, 
+				int noEcho, Error *e )
+			    { Output(); ui->Prompt( msg, rsp, noEcho, e ); }
+	virtual void	Edit( FileSys *f1, Error *e )
+			    { Output(); ui->Edit( f1, e ); }
+	virtual void	Diff( FileSys *f1, FileSys *f2, int doPage,
+				char *diffFlags, Error *e )
+			    { Output(); ui->Diff( f1, f2, doPage, diffFlags, e ); }
+
+		// Hand over any errors we've been holding on to
+		void	Output()
+			    { if ( ! output++ ) Finish(); }
+		void	Finish();
+		void	Clear();
+
+		int	Retryable()	{ return ! output; }
+
+    private:
+	ClientUser		*ui;
+	VarArray		errors;
+	int			output;
+};
+
+void
+RetryUser::HandleError( Error *err )
+{
+	if ( output )
+	{
+	    ui->HandleError( err );
+	    return;
+	}
+
+	HeldError *h = new HeldError;
+	h->err = *err;
+	h->isText = 0;
+	errors.Put( h );
+}
+
+void
+RetryUser::OutputError( const_char *errBuf )
+{
+	if ( output )
+	{
+	    ui->OutputError( errBuf );
+	    return;
+	}
+
+	HeldError *h = new HeldError;
+	h->text.Set( errBuf );
+	h->isText = 1;
+	errors.Put( h );
+}
+
+/*
+ * Errors go to the real ClientUser the way they came to us, so that its
+ * HandleError() still sees the Error itself.
+ */
+void
+RetryUser::Finish()
+{
+	for ( int i = 0; i < errors.Count(); i++ )
+	{
+	    HeldError *h = (HeldError *)errors.Get( i );
+
+	    if ( h->isText )
+		ui->OutputError( h->text.Text() );
+	    else
+		ui->HandleError( &h->err );
+	}
+	Clear();
+}
+
+void
+RetryUser::Clear()
+{
+	for ( int i = 0; i < errors.Count(); i++ )
+	    delete (HeldError *)errors.Get( i );
+	errors.Clear();
+}
+
+/*
+ * Runs a command on a cached connection. If it's read-only and the 
+ * connection turns out to have been dropped before the command produced
+ * any output, reconnect and run it again.
+ *
+ * Returns 0 if the connection was dropped and couldn't be remade. It's
+ * been closed and taken out of the cache by then, so it mustn't be 
+ * Release()d or Final()ed again; the caller just deletes it.
+ */
+int
+ConnCache::Run( ClientApi *c, const char *cmd, int argc, char **argv,
+		ClientUser *ui, Error *e )
+{
+	if ( ! ReadOnly( cmd, argc, argv ) )
+	{
+	    c->SetArgv( argc, argv );
+	    c->Run( cmd, ui );
+	    return 1;
+	}
+
+	RetryUser	retry( ui );
+
+	c->SetArgv( argc, argv );
+	c->Run( cmd, &retry );
+
+	if ( ! c->Dropped() || ! retry.Retryable() )
+	{
+	    retry.Finish();
+	    return 1;
+	}
+
+	// Reconnect with the same ClientApi, which still has the settings
+	e->Clear();
+	c->Final( e );
+	e->Clear();
+	c->Init( e );
+	if ( e->Test() )
+	{
+	    {
+		P4Lock	lock( &idleLock );
+		delete TakeBusy( c );
+	    }
+
+	    // Why the first attempt failed, then why we couldn't retry it
+	    retry.Finish();
+	    ui->HandleError( e );
+	    return 0;
+	}
+
+	c->SetArgv( argc, argv );
+	c->Run( cmd, ui );
+	return 1;
+}
@@ -0,0 +1,62 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * ConnCache - a process wide cache of initialised connections, so that
+ * short lived P4::Client objects with the same settings don't each pay 
+ * for a connect, a protocol handshake and a login check.
+ *
+ * Connections are keyed on everything in a P4Settings except the 
+ * working directory, which is just set on the connection when it's 
+ * handed out. The key is remembered with the connection, and Release()
+ * puts it back under that key. A connection is checked with Dropped()
+ * both when it's handed out and when it's given back, and dropped ones
+ * are discarded.
+ *
+ * A connection can still be found to have gone away (e.g. timed out by
+ * the server) only when it's next used, so Run() retries read-only 
+ * commands once on a fresh connection if they fail that way before 
+ * producing any output.
+ */
+
+class P4Settings;
+
+class ConnCache
+{
+    public:
+	static	ClientApi *Get( P4Settings *s, Error *e );
+	static	int	Release( ClientApi *c );
+	static	void	Flush();
+
+	static	int	ReadOnly( const char *cmd, int argc, char **argv );
+	static	int	Run( ClientApi *c, const char *cmd, int argc, 
+			     char **argv, ClientUser *ui, Error *e );
+
+    private:
+	static	void	Key( P4Settings *s, StrBuf &key );
+};
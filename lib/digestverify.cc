@@ -0,0 +1,431 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+#include "md5.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef OS_NT
+#  include <io.h>
+#  include <windows.h>
+#  define DV_SEP	'\\'
+#else
+#  include <unistd.h>
+#  include <dirent.h>
+#  include <sys/mman.h>
+#  define DV_SEP	'/'
+#endif
+
+#ifndef O_BINARY
+#  define O_BINARY 0
+#endif
+
+#include "p4thread.h"
+#include "digestverify.h"
+
+/*
+ * Size of the read buffer used for files too small to be worth mapping,
+ * and the largest chunk we hand to MD5::Update() in one go.
+ */
+#define DV_READ_SIZE	( 64 * 1024 )
+#define DV_MAP_CHUNK	( 256 * 1024 * 1024 )
+
+struct DigestEntry
+{
+	StrBuf	path;
+	StrBuf	digest;
+	StrBuf	local;
+	int	status;
+};
+
+static void
+UpperCase( StrBuf &s )
+{
+	char *p = s.Text();
+	for ( int i = 0; i < (int)s.Length(); i++ )
+	    p[ i ] = toupper( p[ i ] );
+}
+
+static int
+ComparePaths( const char *a, const char *b )
+{
+#ifdef OS_NT
+	return stricmp( a, b );
+#else
+	return strcmp( a, b );
+#endif
+}
+
+static int
+CompareEntries( const void *a, const void *b )
+{
+	return ComparePaths( (*(DigestEntry **)a)->path.Text(),
+			     (*(DigestEntry **)b)->path.Text() );
+}
+
+
+DigestVerify::DigestVerify()
+{
+	entries = 0;
+	count = 0;
+	alloc = 0;
+	next = 0;
+	threads = 4;
+	mmapMin = 1024 * 1024;
+	sorted = 0;
+	extras = 0;
+	nExtras = 0;
+	extrasAlloc = 0;
+}
+
+DigestVerify::~DigestVerify()
+{
+	for ( int i = 0; i < count; i++ )
+	    delete entries[ i ];
+	for ( int j = 0; j < nExtras; j++ )
+	    delete extras[ j ];
+
+	free( entries );
+	free( sorted );
+	free( extras );
+}
+
+void
+DigestVerify::Add( const char *path, const char *digest )
+{
+	if ( count == alloc )
+	{
+	    alloc = alloc ? alloc * 2 : 1024;
+	    entries = (DigestEntry **)realloc( entries, 
+	    				alloc * sizeof( DigestEntry * ) );
+	}
+
+	DigestEntry *d = new DigestEntry;
+	d->path.Set( path );
+	d->digest.Set( digest );
+	d->status = DV_UNCHECKED;
+	UpperCase( d->digest );
+	entries[ count++ ] = d;
+}
+
+int
+DigestVerify::Status( int i )
+{
+	return entries[ i ]->status;
+}
+
+const StrPtr *
+DigestVerify::Path( int i )
+{
+	return &entries[ i ]->path;
+}
+
+const StrPtr *
+DigestVerify::Digest( int i )
+{
+	return &entries[ i ]->digest;
+}
+
+const StrPtr *
+DigestVerify::LocalDigest( int i )
+{
+	return &entries[ i ]->local;
+}
+
+const StrPtr *
+DigestVerify::Extra( int i )
+{
+	return extras[ i ];
+}
+
+/*
+ * Hash all the files. Each worker thread just pulls the next unchecked
+ * entry off the list until there are none left.
+ */
+
+void
+DigestVerify::Verify()
+{
+	next = 0;
+	P4RunThreads( threads < count ? threads : count, Worker, this );
+}
+
+void
+DigestVerify::Worker( void *arg )
+{
+	DigestVerify	*self = (DigestVerify *)arg;
+	char		*buf = new char[ DV_READ_SIZE ];
+
+	for ( ;; )
+	{
+	    int	i;
+	    {
+		P4Lock	l( &self->lock );
+		i = self->next++;
+	    }
+
+	    if ( i >= self->count )
+		break;
+
+	    self->Hash( self->entries[ i ], buf, DV_READ_SIZE );
+	}
+
+	delete [] buf;
+}
+
+void
+DigestVerify::Hash( DigestEntry *d, char *buf, int bufSize )
+{
+	MD5		md5;
+	struct stat	sb;
+	int		fd;
+	int		n;
+
+#ifndef OS_NT
+	// Perforce stores a symlink as the text of its target, so that's
+	// what we hash rather than whatever the link points at.
+	if ( lstat( d->path.Text(), &sb ) < 0 )
+	{
+	    d->status = ( errno == ENOENT ) ? DV_MISSING : DV_MISMATCH;
+	    return;
+	}
+
+	if ( ( sb.st_mode & S_IFMT ) == S_IFLNK )
+	{
+	    if ( ( n = readlink( d->path.Text(), buf, bufSize ) ) < 0 )
+	    {
+		d->status = DV_MISMATCH;
+		return;
+	    }
+
+	    StrRef s( buf, n );
+	    md5.Update( s );
+	    md5.Final( d->local );
+	    UpperCase( d->local );
+	    d->status = d->local == d->digest ? DV_OK : DV_MISMATCH;
+	    return;
+	}
+#endif
+
+	fd = open( d->path.Text(), O_RDONLY | O_BINARY );
+	if ( fd < 0 )
+	{
+	    d->status = ( errno == ENOENT ) ? DV_MISSING : DV_MISMATCH;
+	    return;
+	}
+
+	if ( fstat( fd, &sb ) < 0 || ( sb.st_mode & S_IFMT ) != S_IFREG )
+	{
+	    close( fd );
+	    d->status = DV_MISMATCH;
+	    return;
+	}
+
+#ifndef OS_NT
+	if ( sb.st_size && sb.st_size >= mmapMin )
+	{
+	    void *map = mmap( 0, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	    if ( map != MAP_FAILED )
+	    {
+		const char 	*p = (const char *)map;
+		off_t 		left = sb.st_size;
+
+#ifdef MADV_SEQUENTIAL
+		madvise( map, sb.st_size, MADV_SEQUENTIAL );
+#endif
+		while ( left )
+		{
+		    int chunk = left > DV_MAP_CHUNK ? DV_MAP_CHUNK : (int)left;
+		    StrRef s( p, chunk );
+		    md5.Update( s );
+		    p += chunk;
+		    left -= chunk;
+		}
+		munmap( map, sb.st_size );
+		close( fd );
+
+		md5.Final( d->local );
+		UpperCase( d->local );
+		d->status = d->local == d->digest ? DV_OK : DV_MISMATCH;
+		return;
+	    }
+	    // Couldn't map it, so fall through and read it instead.
+	}
+#endif
+
+	while ( ( n = read( fd, buf, bufSize ) ) > 0 )
+	{
+	    StrRef s( buf, n );
+	    md5.Update( s );
+	}
+	close( fd );
+
+	if ( n < 0 )
+	{
+	    d->status = DV_MISMATCH;
+	    return;
+	}
+
+	md5.Final( d->local );
+	UpperCase( d->local );
+	d->status = d->local == d->digest ? DV_OK : DV_MISMATCH;
+}
+
+/*
+ * Scan a local directory tree for files that aren't in our list. This is
+ * done on the calling thread: it's dominated by directory reads which
+ * don't parallelise well on a single disk.
+ */
+
+void
+DigestVerify::FindExtras( const char *root )
+{
+	StrBuf	dir;
+
+	free( sorted );
+	sorted = (DigestEntry **)malloc( ( count ? count : 1 ) * 
+					sizeof( DigestEntry * ) );
+	memcpy( sorted, entries, count * sizeof( DigestEntry * ) );
+	qsort( sorted, count, sizeof( DigestEntry * ), CompareEntries );
+
+	dir.Set( root );
+	while ( dir.Length() > 1 && 
+		( dir.Text()[ dir.Length() - 1 ] == '/' ||
+		  dir.Text()[ dir.Length() - 1 ] == DV_SEP ) )
+	    dir.SetLength( dir.Length() - 1 );
+	dir.Terminate();
+
+	Walk( dir );
+}
+
+int
+DigestVerify::Known( const StrPtr &path )
+{
+	int	lo = 0;
+	int	hi = count - 1;
+
+	while ( lo <= hi )
+	{
+	    int mid = ( lo + hi ) / 2;
+	    int cmp = ComparePaths( path.Text(), sorted[ mid ]->path.Text() );
+
+	    if ( ! cmp ) return 1;
+	    if ( cmp < 0 ) 
+		hi = mid - 1;
+	    else
+		lo = mid + 1;
+	}
+	return 0;
+}
+
+void
+DigestVerify::AddExtra( const StrPtr &path )
+{
+	if ( nExtras == extrasAlloc )
+	{
+	    extrasAlloc = extrasAlloc ? extrasAlloc * 2 : 64;
+	    extras = (StrBuf **)realloc( extras, 
+	    				extrasAlloc * sizeof( StrBuf * ) );
+	}
+	extras[ nExtras ] = new StrBuf;
+	extras[ nExtras++ ]->Set( path );
+}
+
+#ifdef OS_NT
+
+void
+DigestVerify::Walk( StrBuf &dir )
+{
+	WIN32_FIND_DATA	fd;
+	HANDLE		h;
+	StrBuf		pattern;
+
+	pattern << dir << "\\*";
+	if ( ( h = FindFirstFile( pattern.Text(), &fd ) ) == INVALID_HANDLE_VALUE )
+	    return;
+
+	do
+	{
+	    if ( !strcmp( fd.cFileName, "." ) || !strcmp( fd.cFileName, ".." ) )
+		continue;
+
+	    StrBuf path;
+	    path << dir << "\\" << fd.cFileName;
+
+	    if ( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+		Walk( path );
+	    else if ( ! Known( path ) )
+		AddExtra( path );
+	}
+	while ( FindNextFile( h, &fd ) );
+
+	FindClose( h );
+}
+
+#else
+
+void
+DigestVerify::Walk( StrBuf &dir )
+{
+	DIR		*d;
+	struct dirent	*e;
+	struct stat	sb;
+
+	if ( ! ( d = opendir( dir.Text() ) ) )
+	    return;
+
+	while ( ( e = readdir( d ) ) )
+	{
+	    if ( !strcmp( e->d_name, "." ) || !strcmp( e->d_name, ".." ) )
+		continue;
+
+	    StrBuf path;
+	    path << dir << "/" << e->d_name;
+
+	    // Don't follow symlinks to directories; Perforce treats a
+	    // symlink as a file in its own right.
+	    if ( lstat( path.Text(), &sb ) < 0 )
+		continue;
+
+	    if ( ( sb.st_mode & S_IFMT ) == S_IFDIR )
+		Walk( path );
+	    else if ( ! Known( path ) )
+		AddExtra( path );
+	}
+
+	closedir( d );
+}
+
+#endif
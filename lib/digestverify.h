@@ -0,0 +1,98 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * DigestVerify - checks a set of local files against the MD5 digests
+ * reported by the server (the "digest" field of "p4 fstat -Ol").
+ *
+ * The files are hashed on a pool of native threads; the number of threads
+ * is also the bound on the number of files being read at any one time.
+ * Large files are memory mapped rather than read. Optionally, a local
+ * directory tree can be scanned for files that the server doesn't know
+ * about.
+ *
+ * This class never calls into Perl, so it's safe to use from any thread.
+ * Note that the comparison is of the raw local bytes, so files whose local
+ * form differs from the server's (keyword expansion, CR/LF line endings)
+ * will be reported as mismatches.
+ */
+
+enum DigestStatus
+{
+	DV_UNCHECKED,
+	DV_OK,
+	DV_MISMATCH,
+	DV_MISSING
+};
+
+struct DigestEntry;
+
+class DigestVerify
+{
+    public:
+			DigestVerify();
+			~DigestVerify();
+
+		void	Add( const char *path, const char *digest );
+		void	SetThreads( int n ) 	{ threads = n > 0 ? n : 1; }
+		void	SetMmapMin( long bytes )	{ mmapMin = bytes; }
+
+		void	Verify();
+		void	FindExtras( const char *root );
+
+		int	Count()			{ return count; }
+		int	Status( int i );
+	const StrPtr	*Path( int i );
+	const StrPtr	*Digest( int i );
+	const StrPtr	*LocalDigest( int i );
+
+		int	ExtraCount()		{ return nExtras; }
+	const StrPtr	*Extra( int i );
+
+    private:
+	static	void	Worker( void *self );
+		void	Hash( DigestEntry *d, char *buf, int bufSize );
+		void	Walk( StrBuf &dir );
+		int	Known( const StrPtr &path );
+		void	AddExtra( const StrPtr &path );
+
+    private:
+	DigestEntry	**entries;
+	int		count;
+	int		alloc;
+	int		next;
+	int		threads;
+	long		mmapMin;
+	P4Mutex		lock;
+
+	DigestEntry	**sorted;
+	StrBuf		**extras;
+	int		nExtras;
+	int		extrasAlloc;
+};
+
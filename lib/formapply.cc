@@ -0,0 +1,286 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+#include "vararray.h"
+
+#include "p4thread.h"
+#include "p4connect.h"
+#include "clientusercollect.h"
+#include "formapply.h"
+
+struct FormJob
+{
+	int			done;
+	ClientUserCollect	output;
+};
+
+/*
+ * Form types whose "-o" needs a name. Any name will do as we only want
+ * the specdef that comes back with it.
+ */
+
+static const char *namedForms[] = {
+	"branch", "depot", "group", "label", "ldap", "remote", "server",
+	"stream", 0
+};
+
+
+FormApply::FormApply( P4Settings *s, const char *t, int n, int w )
+{
+	settings = s;
+	type.Set( t );
+	nConnections = n > 0 ? n : 1;
+	window = w > 0 ? w : 1;
+	next = 0;
+	first = 0;
+}
+
+FormApply::~FormApply()
+{
+	for ( int i = 0; i < jobs.Count(); i++ )
+	    delete (FormJob *)jobs.Get( i );
+
+	if ( first )
+	{
+	    Error	e;
+	    first->Final( &e );
+	    delete first;
+	}
+}
+
+/*
+ * Fetch the spec for this form type. This opens the first of the 
+ * workers' connections, asking for specdefs in the handshake, and runs
+ * "<type> -o" on it tagged; Run() then hands it to one of the workers.
+ */
+
+int
+FormApply::GetSpecDef( StrBuf &spec, Error *e )
+{
+	ClientUserCollect	output;
+	char			*argv[ 2 ];
+	int			argc = 0;
+
+	settings->SetProtocol( "specstring", "" );
+
+	first = new ClientApi;
+	if ( ! settings->Connect( first, e ) )
+	{
+	    Error	fe;
+	    first->Final( &fe );
+	    delete first;
+	    first = 0;
+	    return 0;
+	}
+
+	argv[ argc++ ] = (char *)"-o";
+	for ( const char **n = namedForms; *n; n++ )
+	    if ( type == *n )
+	    {
+		argv[ argc++ ] = (char *)"p4perl-specdef";
+		break;
+	    }
+
+	first->SetVar( "tag" );
+	first->SetArgv( argc, argv );
+	first->Run( type.Text(), &output );
+
+	for ( int i = 0; i < output.Count(); i++ )
+	{
+	    StrPtr	*s;
+
+	    if ( output.Type( i ) == CT_ERROR && output.Level( i ) >= E_FAILED )
+	    {
+		e->Set( E_FAILED, "%msg%" ) << *output.Text( i );
+		return 0;
+	    }
+	    if ( output.Type( i ) == CT_STAT &&
+		 ( s = output.Dict( i )->GetVar( "specdef" ) ) )
+	    {
+		spec.Set( s );
+		return 1;
+	    }
+	}
+
+	e->Set( E_FAILED, "No spec returned for %type% forms." ) << type;
+	return 0;
+}
+
+void
+FormApply::Add( const StrPtr &form )
+{
+	FormJob *j = new FormJob;
+	j->done = 0;
+	j->output.SetInput( form );
+	jobs.Put( j );
+}
+
+/*
+ * Record a form that couldn't be formatted, so that the results still
+ * line up with the caller's list. It isn't sent to the server.
+ */
+
+void
+FormApply::AddFailed( const char *msg )
+{
+	FormJob *j = new FormJob;
+	Error	e;
+
+	j->done = 1;
+	e.Set( E_FAILED, "%msg%" ) << msg;
+	j->output.HandleError( &e );
+	jobs.Put( j );
+}
+
+ClientUserCollect *
+FormApply::Output( int form )
+{
+	return &((FormJob *)jobs.Get( form ))->output;
+}
+
+void
+FormApply::Run()
+{
+	int n = nConnections < jobs.Count() ? nConnections : jobs.Count();
+
+	next = 0;
+	P4RunThreads( n, Worker, this );
+
+	// Anything left over means no connection could be made at all.
+	for ( int i = next; i < jobs.Count(); i++ )
+	{
+	    FormJob *j = (FormJob *)jobs.Get( i );
+	    if ( j->done )
+		continue;
+	    if ( ! connectError.Test() )
+		connectError.Set( E_FAILED, "No connection to server." );
+	    j->output.HandleError( &connectError );
+	}
+}
+
+/*
+ * Each worker takes the next form from the list and queues it with
+ * RunTag(). Once it has a window's worth outstanding it waits for the
+ * oldest one before queueing another, so the connection never sits idle
+ * waiting for a reply while there is work to send.
+ *
+ * If the connection drops, the worker stops taking forms and leaves the
+ * rest to the others. The forms it had queued without a reply are failed
+ * rather than sent again, as "-i" isn't safe to repeat. Run() fails any
+ * forms that no worker was left to take.
+ */
+
+void
+FormApply::Worker( void *arg )
+{
+	FormApply	*self = (FormApply *)arg;
+	ClientApi	*client;
+	Error		e;
+	char		*argv[] = { (char *)"-i" };
+	FormJob		**pending;
+	int		head = 0;
+	int		outstanding = 0;
+
+	// The first worker gets the connection GetSpecDef() opened
+	{
+	    P4Lock	l( &self->lock );
+	    client = self->first;
+	    self->first = 0;
+	}
+
+	// A connection that fails leaves its share of the work to the others
+	if ( ! client )
+	{
+	    client = new ClientApi;
+	    if ( ! self->settings->Connect( client, &e ) )
+	    {
+		P4Lock	l( &self->lock );
+		self->connectError = e;
+		delete client;
+		return;
+	    }
+	}
+
+	pending = new FormJob *[ self->window ];
+
+	for ( ;; )
+	{
+	    if ( outstanding == self->window )
+	    {
+		client->WaitTag( &pending[ head ]->output );
+		head = ( head + 1 ) % self->window;
+		outstanding--;
+	    }
+
+	    if ( client->Dropped() )
+		break;
+
+	    int	i;
+	    {
+		P4Lock	l( &self->lock );
+		i = self->next++;
+	    }
+
+	    if ( i >= self->jobs.Count() )
+		break;
+
+	    FormJob *j = (FormJob *)self->jobs.Get( i );
+
+	    if ( j->done )
+		continue;
+
+	    client->SetArgv( 1, argv );
+	    client->RunTag( self->type.Text(), &j->output );
+	    pending[ ( head + outstanding++ ) % self->window ] = j;
+	}
+
+	client->WaitTag();
+
+	// Forms queued behind the drop got no reply at all
+	if ( client->Dropped() )
+	{
+	    Error	lost;
+	    lost.Set( E_FAILED, "Connection to server lost." );
+
+	    for ( int n = 0; n < outstanding; n++ )
+	    {
+		FormJob *j = pending[ ( head + n ) % self->window ];
+		if ( ! j->output.Count() )
+		    j->output.HandleError( &lost );
+	    }
+
+	    P4Lock	l( &self->lock );
+	    if ( ! self->connectError.Test() )
+		self->connectError = lost;
+	}
+
+	client->Final( &e );
+	delete client;
+	delete [] pending;
+}
@@ -0,0 +1,73 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * FormApply - applies a batch of forms of one type ("p4 <type> -i") over
+ * one or more connections.
+ *
+ * The forms are formatted up front against a single copy of the spec,
+ * fetched once by GetSpecDef() on the first of the connections. Each
+ * connection then keeps a window of commands outstanding with RunTag()
+ * rather than waiting for the reply to one form before sending the next,
+ * so a large batch costs roughly one round trip per window rather than
+ * one per form. The output of every form is collected separately for the
+ * caller to inspect once they've all finished.
+ */
+
+struct FormJob;
+
+class FormApply
+{
+    public:
+			FormApply( P4Settings *settings, const char *type,
+				   int nConnections, int window );
+			~FormApply();
+
+		int	GetSpecDef( StrBuf &spec, Error *e );
+
+		void	Add( const StrPtr &form );
+		void	AddFailed( const char *msg );
+		void	Run();
+
+		int	Forms()		{ return jobs.Count(); }
+		ClientUserCollect *Output( int form );
+
+    private:
+	static	void	Worker( void *self );
+
+    private:
+	P4Settings	*settings;
+	StrBuf		type;
+	int		nConnections;
+	int		window;
+	VarArray	jobs;
+	int		next;
+	ClientApi	*first;
+	P4Mutex		lock;
+	Error		connectError;
+};
@@ -0,0 +1,874 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+#include "vararray.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef OS_NT
+#  include <io.h>
+#else
+#  include <unistd.h>
+#  include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#  define O_BINARY 0
+#endif
+
+#include "strhash.h"
+#include "haveindex.h"
+
+#define HAVE_MAGIC	"P4HI"
+#define HAVE_VERSION	1
+
+/*
+ * On-disk layout: a HaveHeader, then count HaveRecords sorted by depot
+ * path, then count record numbers giving the order by local path, then
+ * the string pool. Strings are NUL terminated and referred to by their
+ * offset in the pool.
+ */
+
+struct HaveHeader
+{
+	char		magic[ 4 ];
+	unsigned int	version;
+	unsigned int	count;
+	unsigned int	poolSize;
+};
+
+struct HaveRecord
+{
+	unsigned int	depot;
+	unsigned int	client;
+	unsigned int	digest;
+	unsigned int	rev;
+};
+
+/*
+ * An in-memory change made since the file was written.
+ */
+
+struct HaveDelta
+{
+	StrBuf		depot;
+	StrBuf		client;
+	StrBuf		digest;
+	int		rev;
+	int		removed;
+	int		seen;
+};
+
+/*
+ * Used by Save() to sort the merged entries.
+ */
+
+struct HaveLoadFile
+{
+	StrBuf		depotFile;
+	StrBuf		clientFile;
+	StrBuf		digest;
+	int		rev;
+	int		hasClient;
+	int		hasDigest;
+};
+
+struct HaveSave
+{
+	const char	*depot;
+	const char	*client;
+	const char	*digest;
+	int		rev;
+	unsigned int	index;
+};
+
+static int
+CompareDepot( const void *a, const void *b )
+{
+	return strcmp( (*(HaveSave **)a)->depot, (*(HaveSave **)b)->depot );
+}
+
+static int
+CompareClient( const void *a, const void *b )
+{
+	return strcmp( (*(HaveSave **)a)->client, (*(HaveSave **)b)->client );
+}
+
+
+HaveIndex::HaveIndex()
+{
+	map = 0;
+	mapSize = 0;
+	baseCount = 0;
+	records = 0;
+	clientOrder = 0;
+	pool = 0;
+	ignoreBase = 0;
+	count = 0;
+	dirty = 0;
+	byDepot = new StrHash;
+	byClient = new StrHash;
+}
+
+HaveIndex::~HaveIndex()
+{
+	Close();
+	delete byDepot;
+	delete byClient;
+}
+
+/*
+ * Open an index file. A file that doesn't exist yet is just an empty
+ * index: it'll be created by Save().
+ */
+
+int
+HaveIndex::Open( const char *p, Error *e )
+{
+	Close();
+	path.Set( p );
+	Map( e );
+	count = baseCount;
+	return ! e->Test();
+}
+
+void
+HaveIndex::Close()
+{
+	for ( int i = 0; i < byDepot->Count(); i++ )
+	    delete (HaveDelta *)byDepot->Value( i );
+	byDepot->Clear();
+	byClient->Clear();
+
+	Unmap();
+	ignoreBase = 0;
+	count = 0;
+	dirty = 0;
+}
+
+/*
+ * Throw away the whole index, ready for it to be rebuilt.
+ */
+
+void
+HaveIndex::Reset()
+{
+	for ( int i = 0; i < byDepot->Count(); i++ )
+	    delete (HaveDelta *)byDepot->Value( i );
+	byDepot->Clear();
+	byClient->Clear();
+
+	ignoreBase = 1;
+	count = 0;
+	dirty = 1;
+}
+
+void
+HaveIndex::Map( Error *e )
+{
+	struct stat	sb;
+	int		fd;
+	HaveHeader	*h;
+
+	if ( ( fd = open( path.Text(), O_RDONLY | O_BINARY ) ) < 0 )
+	    return;
+
+	if ( fstat( fd, &sb ) < 0 || sb.st_size < (long)sizeof( HaveHeader ) )
+	{
+	    close( fd );
+	    e->Set( E_FAILED, "Have index %path% is not valid." ) 
+	    	<< path.Text();
+	    return;
+	}
+
+	mapSize = sb.st_size;
+#ifdef OS_NT
+	map = (char *)malloc( mapSize );
+	if ( read( fd, map, mapSize ) != mapSize )
+	{
+	    free( map );
+	    map = 0;
+	}
+#else
+	map = (char *)mmap( 0, mapSize, PROT_READ, MAP_SHARED, fd, 0 );
+	if ( map == (char *)MAP_FAILED )
+	    map = 0;
+#endif
+	close( fd );
+
+	if ( ! map )
+	{
+	    e->Sys( "mmap", path.Text() );
+	    return;
+	}
+
+	h = (HaveHeader *)map;
+	if ( memcmp( h->magic, HAVE_MAGIC, 4 ) || h->version != HAVE_VERSION ||
+	     mapSize != (long)( sizeof( HaveHeader ) + 
+	     		h->count * sizeof( HaveRecord ) +
+			h->count * sizeof( unsigned int ) + h->poolSize ) )
+	{
+	    Unmap();
+	    e->Set( E_FAILED, "Have index %path% is not valid." ) 
+	    	<< path.Text();
+	    return;
+	}
+
+	baseCount = h->count;
+	records = (HaveRecord *)( map + sizeof( HaveHeader ) );
+	clientOrder = (unsigned int *)( records + baseCount );
+	pool = (char *)( clientOrder + baseCount );
+}
+
+void
+HaveIndex::Unmap()
+{
+	if ( map )
+	{
+#ifdef OS_NT
+	    free( map );
+#else
+	    munmap( map, mapSize );
+#endif
+	}
+	map = 0;
+	mapSize = 0;
+	baseCount = 0;
+	records = 0;
+	clientOrder = 0;
+	pool = 0;
+}
+
+int
+HaveIndex::BaseDepot( const StrPtr &p )
+{
+	int lo = 0;
+	int hi = ignoreBase ? -1 : baseCount - 1;
+
+	while ( lo <= hi )
+	{
+	    int mid = ( lo + hi ) / 2;
+	    int cmp = strcmp( p.Text(), pool + records[ mid ].depot );
+
+	    if ( ! cmp ) return mid;
+	    if ( cmp < 0 )
+		hi = mid - 1;
+	    else
+		lo = mid + 1;
+	}
+	return -1;
+}
+
+int
+HaveIndex::BaseClient( const StrPtr &p )
+{
+	int lo = 0;
+	int hi = ignoreBase ? -1 : baseCount - 1;
+
+	while ( lo <= hi )
+	{
+	    int mid = ( lo + hi ) / 2;
+	    int rec = clientOrder[ mid ];
+	    int cmp = strcmp( p.Text(), pool + records[ rec ].client );
+
+	    if ( ! cmp ) return rec;
+	    if ( cmp < 0 )
+		hi = mid - 1;
+	    else
+		lo = mid + 1;
+	}
+	return -1;
+}
+
+void
+HaveIndex::BaseEntry( int i, HaveEntry *entry )
+{
+	entry->depotFile.Set( pool + records[ i ].depot );
+	entry->clientFile.Set( pool + records[ i ].client );
+	entry->digest.Set( pool + records[ i ].digest );
+	entry->rev = records[ i ].rev;
+}
+
+/*
+ * Find a file by depot path. Sets base to the record in the mapped file
+ * (or -1) and d to the in-memory change (or 0). Returns true if the file
+ * is in the index.
+ */
+
+int
+HaveIndex::FindDepot( const StrPtr &p, int &base, HaveDelta *&d )
+{
+	d = (HaveDelta *)byDepot->Find( p );
+	base = BaseDepot( p );
+
+	if ( d ) return ! d->removed;
+	return base >= 0;
+}
+
+/*
+ * Find a file by local path. Only one of base and d will be set. An
+ * in-memory change to the depot file overrides the mapped record.
+ */
+
+int
+HaveIndex::FindClient( const StrPtr &p, int &base, HaveDelta *&d )
+{
+	d = (HaveDelta *)byClient->Find( p );
+	base = -1;
+
+	if ( d && ! d->removed && d->client == p )
+	    return 1;
+
+	d = 0;
+	if ( ( base = BaseClient( p ) ) < 0 )
+	    return 0;
+
+	StrRef	depot( pool + records[ base ].depot );
+	if ( ( d = (HaveDelta *)byDepot->Find( depot ) ) )
+	{
+	    base = -1;
+	    if ( d->removed || d->client != p )
+	    {
+		d = 0;
+		return 0;
+	    }
+	}
+	return 1;
+}
+
+/*
+ * Look up a file by depot path or local path.
+ */
+
+int
+HaveIndex::Lookup( const StrPtr &p, HaveEntry *entry )
+{
+	HaveDelta	*d = 0;
+	int		base = -1;
+	int		found = 0;
+
+	if ( p.Length() > 2 && p.Text()[ 0 ] == '/' && p.Text()[ 1 ] == '/' )
+	    found = FindDepot( p, base, d );
+
+	if ( ! found )
+	    found = FindClient( p, base, d );
+
+	if ( ! found )
+	    return 0;
+
+	if ( d )
+	{
+	    entry->depotFile.Set( d->depot );
+	    entry->clientFile.Set( d->client );
+	    entry->digest.Set( d->digest );
+	    entry->rev = d->rev;
+	}
+	else
+	{
+	    BaseEntry( base, entry );
+	}
+	return 1;
+}
+
+/*
+ * Record that we now have revision rev of a file. The local path and
+ * digest are left alone if they aren't supplied, except that the digest
+ * is cleared if the revision has changed.
+ */
+
+void
+HaveIndex::Update( const StrPtr &depot, const StrPtr *client,
+			int rev, const StrPtr *digest )
+{
+	HaveDelta	*d;
+	int		base;
+	int		oldRev = 0;
+	int		present = FindDepot( depot, base, d );
+
+	if ( present )
+	    oldRev = d ? d->rev : records[ base ].rev;
+
+	if ( ! d )
+	{
+	    d = new HaveDelta;
+	    d->depot.Set( depot );
+	    d->rev = 0;
+	    d->seen = 0;
+	    if ( base >= 0 )
+	    {
+		d->client.Set( pool + records[ base ].client );
+		d->digest.Set( pool + records[ base ].digest );
+	    }
+	    byDepot->Insert( d->depot, d );
+	}
+
+	if ( ! present )
+	    count++;
+
+	d->removed = 0;
+	if ( client && client->Length() )
+	    d->client.Set( *client );
+
+	if ( digest )
+	    d->digest.Set( *digest );
+	else if ( rev != oldRev )
+	    d->digest.Clear();
+
+	d->rev = rev;
+	if ( d->client.Length() )
+	    byClient->Insert( d->client, d );
+
+	dirty = 1;
+}
+
+void
+HaveIndex::Remove( const StrPtr &depot )
+{
+	HaveDelta	*d;
+	int		base;
+
+	if ( ! FindDepot( depot, base, d ) )
+	    return;
+
+	if ( ! d )
+	{
+	    d = new HaveDelta;
+	    d->depot.Set( depot );
+	    d->seen = 0;
+	    byDepot->Insert( d->depot, d );
+	}
+
+	d->removed = 1;
+	count--;
+	dirty = 1;
+}
+
+/*
+ * Apply a tagged record from "p4 sync" or "p4 submit" to the index.
+ */
+
+void
+HaveIndex::ApplyStat( const StrPtr &cmd, StrDict *d )
+{
+	StrPtr	*depot = d->GetVar( "depotFile" );
+	StrPtr	*rev = d->GetVar( "rev" );
+	StrPtr	*action = d->GetVar( "action" );
+
+	if ( ! depot || ! rev || ! action )
+	    return;
+
+	if ( *action == "deleted" || *action == "delete" || 
+	     *action == "move/delete" )
+	    Remove( *depot );
+	else
+	    Update( *depot, d->GetVar( "clientFile" ), rev->Atoi(), 0 );
+}
+
+/*
+ * Apply a line of untagged output from "p4 sync" or "p4 submit".
+ *
+ *	sync:	//depot/file#3 - updating /ws/file
+ *	submit:	edit //depot/file#4
+ */
+
+void
+HaveIndex::ApplyInfo( const StrPtr &cmd, const char *data )
+{
+	static const char *verbs[] = { 
+	    "added as ", "updating ", "refreshing ", "replacing ", 0 
+	};
+
+	const char	*depot = data;
+	const char	*hash;
+	const char	*rest = 0;
+	int		removed = 0;
+
+	if ( cmd == "submit" )
+	{
+	    if ( ! ( depot = strstr( data, " //" ) ) )
+		return;
+	    depot++;
+	    removed = !strncmp( data, "delete ", 7 ) || 
+	    	     !strncmp( data, "move/delete ", 12 );
+	}
+	else
+	{
+	    if ( ! ( rest = strstr( data, " - " ) ) )
+		return;
+	    rest += 3;
+
+	    if ( !strncmp( rest, "deleted as ", 11 ) )
+		removed = 1;
+	    else
+	    {
+		const char **v;
+		for ( v = verbs; *v && strncmp( rest, *v, strlen( *v ) ); v++ )
+		    ;
+		if ( ! *v )
+		    return;
+		rest += strlen( *v );
+	    }
+	}
+
+	if ( strncmp( depot, "//", 2 ) || ! ( hash = strchr( depot, '#' ) ) )
+	    return;
+
+	StrBuf	file;
+	file.Set( depot, hash - depot );
+
+	if ( removed )
+	    Remove( file );
+	else if ( rest )
+	{
+	    StrRef client( rest );
+	    Update( file, &client, atoi( hash + 1 ), 0 );
+	}
+	else
+	    Update( file, 0, atoi( hash + 1 ), 0 );
+}
+
+/*
+ * Write the merged index to a new file, swap it in and remap it.
+ */
+
+int
+HaveIndex::Save( Error *e )
+{
+	HaveSave	*entries;
+	HaveSave	**sorted;
+	HaveHeader	h;
+	StrBuf		strings;
+	StrBuf		tmp;
+	FILE		*fp;
+	int		n = 0;
+	int		i;
+
+	if ( ! path.Length() )
+	{
+	    e->Set( E_FAILED, "Have index has no file name." );
+	    return 0;
+	}
+
+	i = baseCount + byDepot->Count() + 1;
+	entries = new HaveSave[ i ];
+	sorted = new HaveSave *[ i ];
+
+	for ( i = 0; ! ignoreBase && i < baseCount; i++ )
+	{
+	    StrRef depot( pool + records[ i ].depot );
+	    if ( byDepot->Find( depot ) )
+		continue;
+
+	    entries[ n ].depot = pool + records[ i ].depot;
+	    entries[ n ].client = pool + records[ i ].client;
+	    entries[ n ].digest = pool + records[ i ].digest;
+	    entries[ n ].rev = records[ i ].rev;
+	    n++;
+	}
+
+	for ( i = 0; i < byDepot->Count(); i++ )
+	{
+	    HaveDelta *d = (HaveDelta *)byDepot->Value( i );
+	    if ( d->removed )
+		continue;
+
+	    entries[ n ].depot = d->depot.Text();
+	    entries[ n ].client = d->client.Text();
+	    entries[ n ].digest = d->digest.Text();
+	    entries[ n ].rev = d->rev;
+	    n++;
+	}
+
+	for ( i = 0; i < n; i++ )
+	    sorted[ i ] = &entries[ i ];
+	qsort( sorted, n, sizeof( HaveSave * ), CompareDepot );
+
+	tmp << path << ".tmp";
+	if ( ! ( fp = fopen( tmp.Text(), "wb" ) ) )
+	{
+	    e->Sys( "open", tmp.Text() );
+	    delete [] sorted;
+	    delete [] entries;
+	    return 0;
+	}
+
+	// The header goes first, but we don't know the size of the string
+	// pool until we've written the records so it's filled in later.
+	memcpy( h.magic, HAVE_MAGIC, 4 );
+	h.version = HAVE_VERSION;
+	h.count = n;
+	h.poolSize = 0;
+	fwrite( &h, sizeof( h ), 1, fp );
+
+	// Records, in depot order. Build the string pool as we go.
+	for ( i = 0; i < n; i++ )
+	{
+	    HaveRecord	r;
+
+	    sorted[ i ]->index = i;
+	    r.depot = strings.Length();
+	    strings.Append( sorted[ i ]->depot );
+	    strings.Extend( '\0' );
+	    r.client = strings.Length();
+	    strings.Append( sorted[ i ]->client );
+	    strings.Extend( '\0' );
+	    r.digest = strings.Length();
+	    strings.Append( sorted[ i ]->digest );
+	    strings.Extend( '\0' );
+	    r.rev = sorted[ i ]->rev;
+	    fwrite( &r, sizeof( r ), 1, fp );
+	}
+
+	// Then the order by local path
+	qsort( sorted, n, sizeof( HaveSave * ), CompareClient );
+	for ( i = 0; i < n; i++ )
+	    fwrite( &sorted[ i ]->index, sizeof( unsigned int ), 1, fp );
+
+	fwrite( strings.Text(), 1, strings.Length(), fp );
+
+	// Now go back and fill in the size of the pool
+	h.poolSize = strings.Length();
+	fseek( fp, 0, SEEK_SET );
+	fwrite( &h, sizeof( h ), 1, fp );
+
+	delete [] sorted;
+	delete [] entries;
+
+	if ( ferror( fp ) | fclose( fp ) )
+	{
+	    e->Sys( "write", tmp.Text() );
+	    remove( tmp.Text() );
+	    return 0;
+	}
+
+	// The in-memory changes point into the old mapping, so swap
+	// the files only once we're done with them.
+	Close();
+#ifdef OS_NT
+	remove( path.Text() );
+#endif
+	if ( rename( tmp.Text(), path.Text() ) < 0 )
+	{
+	    e->Sys( "rename", tmp.Text() );
+	    return 0;
+	}
+
+	return Open( path.Text(), e );
+}
+
+
+HaveLoad::~HaveLoad()
+{
+	for ( int i = 0; i < files.Count(); i++ )
+	    delete (HaveLoadFile *)files.Get( i );
+}
+
+/*
+ * Replace the contents of the index with the files loaded.
+ */
+
+void
+HaveLoad::Apply()
+{
+	index->Reset();
+
+	for ( int i = 0; i < files.Count(); i++ )
+	{
+	    HaveLoadFile *f = (HaveLoadFile *)files.Get( i );
+
+	    index->Update( f->depotFile, f->hasClient ? &f->clientFile : 0,
+			   f->rev, f->hasDigest ? &f->digest : 0 );
+	}
+}
+
+void
+HaveLoad::HandleError( Error *err )
+{
+	if ( err->GetSeverity() < E_FAILED )
+	    return;
+
+	errors++;
+	last = *err;
+}
+
+void
+HaveLoad::OutputStat( StrDict *varList )
+{
+	StrPtr	*depot = varList->GetVar( "depotFile" );
+	StrPtr	*rev = varList->GetVar( "haveRev" );
+	StrPtr	*path = varList->GetVar( "path" );
+	StrPtr	*head = varList->GetVar( "headRev" );
+	StrPtr	*digest = varList->GetVar( "digest" );
+
+	if ( ! depot || ! rev )
+	    return;
+
+	// "have" gives us the local path as "path", fstat as "clientFile"
+	if ( ! path )
+	    path = varList->GetVar( "clientFile" );
+
+	if ( digest && ( ! head || *head != *rev ) )
+	    digest = 0;
+
+	HaveLoadFile *f = new HaveLoadFile;
+
+	f->depotFile.Set( depot );
+	f->rev = rev->Atoi();
+	if ( ( f->hasClient = path != 0 ) )
+	    f->clientFile.Set( path );
+	if ( ( f->hasDigest = digest != 0 ) )
+	    f->digest.Set( digest );
+	files.Put( f );
+}
+
+
+HaveCheck::HaveCheck( HaveIndex *i )
+{
+	index = i;
+	errors = 0;
+	seenBase = (char *)calloc( index->baseCount + 1, 1 );
+
+	for ( int j = 0; j < index->byDepot->Count(); j++ )
+	    ((HaveDelta *)index->byDepot->Value( j ))->seen = 0;
+}
+
+HaveCheck::~HaveCheck()
+{
+	int	i;
+
+	free( seenBase );
+	for ( i = 0; i < missing.Count(); i++ )
+	    delete (StrBuf *)missing.Get( i );
+	for ( i = 0; i < stale.Count(); i++ )
+	    delete (StrBuf *)stale.Get( i );
+	for ( i = 0; i < extra.Count(); i++ )
+	    delete (StrBuf *)extra.Get( i );
+}
+
+void
+HaveCheck::HandleError( Error *err )
+{
+	// "file(s) not on client" and friends are only warnings
+	if ( err->GetSeverity() >= E_FAILED )
+	    errors++;
+}
+
+void
+HaveCheck::OutputStat( StrDict *varList )
+{
+	StrPtr	*depot = varList->GetVar( "depotFile" );
+	StrPtr	*rev = varList->GetVar( "haveRev" );
+
+	if ( depot && rev )
+	    Check( *depot, rev->Atoi() );
+}
+
+/*
+ *	//depot/file#3 - /ws/file
+ */
+
+void
+HaveCheck::OutputInfo( char level, const_char *data )
+{
+	const char	*hash = strchr( data, '#' );
+
+	if ( ! hash || strncmp( data, "//", 2 ) )
+	    return;
+
+	StrBuf	depot;
+	depot.Set( data, hash - data );
+	Check( depot, atoi( hash + 1 ) );
+}
+
+void
+HaveCheck::Check( const StrPtr &depot, int rev )
+{
+	HaveDelta	*d;
+	int		base;
+	int		have;
+
+	if ( ! index->FindDepot( depot, base, d ) )
+	{
+	    StrBuf *s = new StrBuf;
+	    s->Set( depot );
+	    missing.Put( s );
+	    return;
+	}
+
+	if ( d )
+	{
+	    d->seen = 1;
+	    have = d->rev;
+	}
+	else
+	{
+	    seenBase[ base ] = 1;
+	    have = index->records[ base ].rev;
+	}
+
+	if ( have != rev )
+	{
+	    StrBuf *s = new StrBuf;
+	    s->Set( depot );
+	    stale.Put( s );
+	}
+}
+
+void
+HaveCheck::Finish()
+{
+	int	i;
+
+	for ( i = 0; ! index->ignoreBase && i < index->baseCount; i++ )
+	{
+	    StrRef depot( index->pool + index->records[ i ].depot );
+	    if ( seenBase[ i ] || index->byDepot->Find( depot ) )
+		continue;
+
+	    StrBuf *s = new StrBuf;
+	    s->Set( depot );
+	    extra.Put( s );
+	}
+
+	for ( i = 0; i < index->byDepot->Count(); i++ )
+	{
+	    HaveDelta *d = (HaveDelta *)index->byDepot->Value( i );
+	    if ( d->removed || d->seen )
+		continue;
+
+	    StrBuf *s = new StrBuf;
+	    s->Set( d->depot );
+	    extra.Put( s );
+	}
+}
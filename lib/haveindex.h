@@ -0,0 +1,170 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * HaveIndex - a local, memory mapped copy of the have list.
+ *
+ * The index is a single file holding a table of records sorted by depot
+ * path, a second table giving the order of the records by local path, and
+ * a pool of strings. Lookups are a binary search on the mapped file, so
+ * they need neither a server round trip nor any parsing at startup.
+ *
+ * Changes made after the file was written (from sync or submit output,
+ * see ApplyStat() and ApplyInfo()) are kept in memory on top of the mapped
+ * file, and are merged into a new file by Save().
+ *
+ * The file is in native byte order and isn't intended to be shared 
+ * between machines.
+ */
+
+struct HaveEntry
+{
+	StrRef		depotFile;
+	StrRef		clientFile;
+	StrRef		digest;
+	int		rev;
+};
+
+struct HaveRecord;
+struct HaveDelta;
+class StrHash;
+
+class HaveIndex
+{
+    public:
+			HaveIndex();
+			~HaveIndex();
+
+		int	Open( const char *path, Error *e );
+		int	Save( Error *e );
+		void	Close();
+		void	Reset();
+
+		int	Lookup( const StrPtr &path, HaveEntry *entry );
+		int	Count()		{ return count; }
+		int	Dirty()		{ return dirty; }
+
+		void	Update( const StrPtr &depot, const StrPtr *client,
+				int rev, const StrPtr *digest );
+		void	Remove( const StrPtr &depot );
+
+		void	ApplyStat( const StrPtr &cmd, StrDict *d );
+		void	ApplyInfo( const StrPtr &cmd, const char *data );
+
+    private:
+		int	FindDepot( const StrPtr &path, int &base, HaveDelta *&d );
+		int	FindClient( const StrPtr &path, int &base, HaveDelta *&d );
+		int	BaseDepot( const StrPtr &path );
+		int	BaseClient( const StrPtr &path );
+		void	BaseEntry( int i, HaveEntry *entry );
+		void	Map( Error *e );
+		void	Unmap();
+
+    friend class HaveCheck;
+
+    private:
+	StrBuf		path;
+	char		*map;
+	long		mapSize;
+	int		baseCount;
+	HaveRecord	*records;
+	unsigned int	*clientOrder;
+	char		*pool;
+	int		ignoreBase;
+
+	StrHash		*byDepot;
+	StrHash		*byClient;
+	int		count;
+	int		dirty;
+};
+
+/*
+ * HaveLoad - fills a HaveIndex from the tagged output of "p4 have" or
+ * "p4 fstat -Ol". The digest reported by fstat is that of the head 
+ * revision, so it's only kept for files we have at head.
+ *
+ * The files are held until Apply() so that a load which fails part way
+ * through leaves the index as it was.
+ */
+
+class HaveLoad : public ClientUser
+{
+    public:
+			HaveLoad( HaveIndex *i )	{ index = i; errors = 0; }
+	virtual		~HaveLoad();
+
+	virtual void	HandleError( Error *err );
+	virtual void	OutputStat( StrDict *varList );
+
+		void	Apply();
+
+		int	Errors()	{ return errors; }
+		Error	*LastError()	{ return &last; }
+
+    private:
+	HaveIndex	*index;
+	VarArray	files;
+	Error		last;
+	int		errors;
+};
+
+/*
+ * HaveCheck - compares a HaveIndex against the output of "p4 have" as it
+ * arrives, tagged or not. After the command has run, Finish() adds any 
+ * files in the index which the server didn't mention.
+ */
+
+class HaveCheck : public ClientUser
+{
+    public:
+			HaveCheck( HaveIndex *index );
+	virtual		~HaveCheck();
+
+	virtual void	HandleError( Error *err );
+	virtual void	OutputInfo( char level, const_char *data );
+	virtual void	OutputStat( StrDict *varList );
+
+		void	Finish();
+
+		VarArray *Missing()	{ return &missing; }
+		VarArray *Stale()	{ return &stale; }
+		VarArray *Extra()	{ return &extra; }
+		int	Errors()	{ return errors; }
+
+    private:
+		void	Check( const StrPtr &depot, int rev );
+
+    private:
+	HaveIndex	*index;
+	char		*seenBase;
+	VarArray	missing;
+	VarArray	stale;
+	VarArray	extra;
+	int		errors;
+};
+
@@ -0,0 +1,64 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+
+#include "p4connect.h"
+
+/*
+ * Copy the settings into a fresh ClientApi object. Must be done before
+ * Init() as protocol settings are sent during the handshake.
+ */
+
+void
+P4Settings::Apply( ClientApi *c )
+{
+	StrRef	var, val;
+
+	if ( port.Length() ) 	 c->SetPort( &port );
+	if ( user.Length() ) 	 c->SetUser( &user );
+	if ( client.Length() ) 	 c->SetClient( &client );
+	if ( host.Length() ) 	 c->SetHost( &host );
+	if ( password.Length() ) c->SetPassword( &password );
+	if ( cwd.Length() ) 	 c->SetCwd( &cwd );
+
+	for ( int i = 0; protocol.GetVar( i, var, val ); i++ )
+	    c->SetProtocol( var.Text(), val.Text() );
+}
+
+/*
+ * Apply the settings and connect. Returns true on success.
+ */
+
+int
+P4Settings::Connect( ClientApi *c, Error *e )
+{
+	Apply( c );
+	c->Init( e );
+	return ! e->Test();
+}
@@ -0,0 +1,203 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * Platform specific implementation of the primitives in p4thread.h
+ */
+
+#ifdef OS_NT
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
+#include <stdlib.h>
+
+#include "p4thread.h"
+
+struct P4ThreadStart
+{
+#ifdef OS_NT
+	static unsigned __stdcall Run( void *t )
+#else
+	static void *Run( void *t )
+#endif
+	{
+	    P4Thread *self = (P4Thread *)t;
+	    self->func( self->arg );
+	    return 0;
+	}
+};
+
+#ifdef OS_NT
+
+P4Mutex::P4Mutex()
+{
+	mutex = new CRITICAL_SECTION;
+	InitializeCriticalSection( (CRITICAL_SECTION *)mutex );
+}
+
+P4Mutex::~P4Mutex()
+{
+	DeleteCriticalSection( (CRITICAL_SECTION *)mutex );
+	delete (CRITICAL_SECTION *)mutex;
+}
+
+void
+P4Mutex::Lock()
+{
+	EnterCriticalSection( (CRITICAL_SECTION *)mutex );
+}
+
+void
+P4Mutex::Unlock()
+{
+	LeaveCriticalSection( (CRITICAL_SECTION *)mutex );
+}
+
+int
+P4Thread::Start( P4ThreadFunc f, void *a )
+{
+	func = f;
+	arg = a;
+	thread = (void *)_beginthreadex( 0, 0, P4ThreadStart::Run, this, 0, 0 );
+	return thread != 0;
+}
+
+void
+P4Thread::Join()
+{
+	if ( ! thread ) return;
+	WaitForSingleObject( (HANDLE)thread, INFINITE );
+	CloseHandle( (HANDLE)thread );
+	thread = 0;
+}
+
+#else
+
+P4Mutex::P4Mutex()
+{
+	mutex = new pthread_mutex_t;
+	pthread_mutex_init( (pthread_mutex_t *)mutex, 0 );
+}
+
+P4Mutex::~P4Mutex()
+{
+	pthread_mutex_destroy( (pthread_mutex_t *)mutex );
+	delete (pthread_mutex_t *)mutex;
+}
+
+void
+P4Mutex::Lock()
+{
+	pthread_mutex_lock( (pthread_mutex_t *)mutex );
+}
+
+void
+P4Mutex::Unlock()
+{
+	pthread_mutex_unlock( (pthread_mutex_t *)mutex );
+}
+
+int
+P4Thread::Start( P4ThreadFunc f, void *a )
+{
+	pthread_t	*t = new pthread_t;
+
+	func = f;
+	arg = a;
+	if ( pthread_create( t, 0, P4ThreadStart::Run, this ) )
+	{
+	    delete t;
+	    return 0;
+	}
+	thread = t;
+	return 1;
+}
+
+void
+P4Thread::Join()
+{
+	if ( ! thread ) return;
+	pthread_join( *(pthread_t *)thread, 0 );
+	delete (pthread_t *)thread;
+	thread = 0;
+}
+
+#endif
+
+P4Thread::P4Thread()
+{
+	thread = 0;
+	func = 0;
+	arg = 0;
+}
+
+P4Thread::~P4Thread()
+{
+	Join();
+}
+
+void
+P4RunThreads( int nThreads, P4ThreadFunc func, void *arg )
+{
+	P4Thread	*threads;
+	int		i;
+
+	if ( nThreads <= 1 )
+	{
+	    func( arg );
+	    return;
+	}
+
+	threads = new P4Thread[ nThreads ];
+	for ( i = 0; i < nThreads; i++ )
+	    if ( ! threads[ i ].Start( func, arg ) )
+		break;
+
+	// If we couldn't start any threads at all, do the work ourselves.
+	if ( ! i )
+	    func( arg );
+
+	for ( int j = 0; j < i; j++ )
+	    threads[ j ].Join();
+
+	delete [] threads;
+}
+
+void
+P4Sleep( int ms )
+{
+#ifdef OS_NT
+	Sleep( ms );
+#else
+	usleep( ms * 1000 );
+#endif
+}
@@ -0,0 +1,106 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * Minimal portable threading primitives used by the native (non-Perl)
+ * worker code. Nothing in here may touch the Perl interpreter: worker
+ * threads only ever see plain C++ data and hand their results back to
+ * the calling thread which converts them into Perl data once they've
+ * all been joined.
+ *
+ * The platform specific parts are kept in p4thread.cc so that this header
+ * doesn't drag <windows.h> or <pthread.h> into files which also include
+ * the Perl headers.
+ */
+
+class P4Mutex
+{
+    public:
+			P4Mutex();
+			~P4Mutex();
+
+		void	Lock();
+		void	Unlock();
+
+    private:
+	void		*mutex;
+};
+
+/*
+ * Scoped lock. Unlocks the mutex when it goes out of scope.
+ */
+
+class P4Lock
+{
+    public:
+			P4Lock( P4Mutex *m ) { mutex = m; mutex->Lock(); }
+			~P4Lock() { mutex->Unlock(); }
+
+    private:
+	P4Mutex		*mutex;
+};
+
+/*
+ * A joinable native thread. Start() returns 0 if the thread could not
+ * be created, in which case the caller should run the function inline.
+ */
+
+typedef void	(*P4ThreadFunc)( void *arg );
+
+class P4Thread
+{
+    public:
+			P4Thread();
+			~P4Thread();
+
+		int	Start( P4ThreadFunc func, void *arg );
+		void	Join();
+
+    private:
+	void		*thread;
+	P4ThreadFunc	func;
+	void		*arg;
+
+    friend struct P4ThreadStart;
+};
+
+/*
+ * Run func( arg ) on up to nThreads threads and wait for them all to
+ * finish. The function is expected to pull work from some shared queue
+ * until there is none left. If threads can't be created the work is
+ * done on the calling thread instead.
+ */
+
+void	P4RunThreads( int nThreads, P4ThreadFunc func, void *arg );
+
+/*
+ * Sleep the calling thread for the given number of milliseconds.
+ */
+
+void	P4Sleep( int ms );
+
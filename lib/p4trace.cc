@@ -0,0 +1,163 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef OS_NT
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
+
+#include "p4trace.h"
+
+/*
+ * Number of events kept. Must be a power of two.
+ */
+#define TR_RING_SIZE	8192
+
+static const char *subsysNames[ TR_MAX ] = { "run", "stat", "form", "input" };
+
+
+P4Trace::P4Trace()
+{
+	ring = 0;
+	head = 0;
+	dumpOnError = 0;
+	for ( int i = 0; i < TR_MAX; i++ )
+	    levels[ i ] = 0;
+}
+
+P4Trace::~P4Trace()
+{
+	delete [] ring;
+}
+
+/*
+ * Map a subsystem name to its number. "all" is -1, unknown names -2.
+ */
+
+int
+P4Trace::Subsystem( const char *name )
+{
+	if ( !strcmp( name, "all" ) )
+	    return -1;
+
+	for ( int i = 0; i < TR_MAX; i++ )
+	    if ( !strcmp( name, subsysNames[ i ] ) )
+		return i;
+
+	return -2;
+}
+
+/*
+ * Set the level for a subsystem, or for all of them if subsys is -1. The
+ * ring buffer isn't allocated until something is switched on.
+ */
+
+void
+P4Trace::SetLevel( int subsys, int level )
+{
+	if ( subsys < -1 || subsys >= TR_MAX )
+	    return;
+
+	for ( int i = 0; i < TR_MAX; i++ )
+	    if ( subsys == -1 || subsys == i )
+		levels[ i ] = level;
+
+	if ( level > 0 && ! ring )
+	    ring = new TraceEvent[ TR_RING_SIZE ];
+}
+
+void
+P4Trace::Record( int subsys, int level, const char *msg, 
+			const char *arg, long num )
+{
+	if ( ! ring )
+	    return;
+
+	TraceEvent *ev = &ring[ head++ & ( TR_RING_SIZE - 1 ) ];
+
+#ifdef OS_NT
+	DWORD	t = GetTickCount();
+	ev->sec = t / 1000;
+	ev->usec = ( t % 1000 ) * 1000;
+#else
+	struct timeval	tv;
+	gettimeofday( &tv, 0 );
+	ev->sec = tv.tv_sec;
+	ev->usec = tv.tv_usec;
+#endif
+
+	ev->msg = msg;
+	ev->num = num;
+	ev->subsys = subsys;
+	ev->level = level;
+
+	if ( arg )
+	{
+	    strncpy( ev->arg, arg, TR_ARGLEN - 1 );
+	    ev->arg[ TR_ARGLEN - 1 ] = 0;
+	}
+	else
+	{
+	    ev->arg[ 0 ] = 0;
+	}
+}
+
+/*
+ * Format the events in the buffer, oldest first, one per line.
+ */
+
+void
+P4Trace::Dump( StrBuf &out )
+{
+	unsigned long	first;
+	char		stamp[ 32 ];
+
+	if ( ! ring )
+	    return;
+
+	first = head > TR_RING_SIZE ? head - TR_RING_SIZE : 0;
+	for ( unsigned long i = first; i < head; i++ )
+	{
+	    TraceEvent *ev = &ring[ i & ( TR_RING_SIZE - 1 ) ];
+
+	    sprintf( stamp, "%ld.%06ld", ev->sec, ev->usec );
+	    out << "[" << stamp << "] " << subsysNames[ ev->subsys ] 
+	        << "(" << (int)ev->level << ") " << ev->msg;
+	    if ( ev->arg[ 0 ] )
+		out << ": " << ev->arg;
+	    if ( ev->num >= 0 )
+		out << " (" << (int)ev->num << ")";
+	    out << "\n";
+	}
+}
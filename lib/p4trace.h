@@ -0,0 +1,105 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * Tracing for the marshalling code. 
+ *
+ * Trace points are written with the P4TRACE() macro, which compiles to
+ * nothing unless the extension is built with -DP4PERL_TRACE. When it is
+ * enabled, each event is recorded in binary form - a timestamp, a pointer
+ * to a static message, a short copy of one string argument and a number -
+ * in a fixed size ring buffer belonging to the connection. Nothing is
+ * written anywhere until the buffer is dumped, either on request or when
+ * an error is reported.
+ *
+ * The buffer takes no locks, and it is not lock-free either: Record()
+ * bumps the head without any atomics, so it is only safe with a single
+ * writer. Events are only recorded by ClientUserPerl callbacks, which
+ * run on the thread that owns the Perl interpreter, and dumped by that
+ * same thread between callbacks. The worker threads behind RunParallel(),
+ * ApplyForms() and ParallelSync() collect their output and have it
+ * replayed on the Perl thread; they must never be handed a P4Trace.
+ */
+
+enum TraceSubsystem
+{
+	TR_RUN,		// P4::Client::Run() and friends
+	TR_STAT,	// tagged output: OutputStat, DictToHash, InsertItem
+	TR_FORM,	// form input: HashToForm, FlattenHash
+	TR_INPUT,	// InputData
+	TR_MAX
+};
+
+#define TR_ARGLEN	40
+
+struct TraceEvent
+{
+	long		sec;
+	long		usec;
+	const char	*msg;
+	long		num;
+	unsigned char	subsys;
+	unsigned char	level;
+	char		arg[ TR_ARGLEN ];
+};
+
+class P4Trace
+{
+    public:
+			P4Trace();
+			~P4Trace();
+
+		void	SetLevel( int subsys, int level );
+		int	Level( int subsys )	{ return levels[ subsys ]; }
+		void	SetDumpOnError( int f )	{ dumpOnError = f; }
+		int	DumpOnError()		{ return dumpOnError; }
+
+		void	Record( int subsys, int level, const char *msg,
+				const char *arg, long num );
+		void	Dump( StrBuf &out );
+		void	Clear()			{ head = 0; }
+
+	static	int	Subsystem( const char *name );
+
+    private:
+	TraceEvent	*ring;
+	unsigned long	head;
+	int		levels[ TR_MAX ];
+	int		dumpOnError;
+};
+
+#ifdef P4PERL_TRACE
+# define P4TRACE( t, subsys, level, msg, arg, num ) \
+	do { \
+	    if ( (t) && (t)->Level( subsys ) >= (level) ) \
+		(t)->Record( subsys, level, msg, arg, num ); \
+	} while ( 0 )
+#else
+# define P4TRACE( t, subsys, level, msg, arg, num )
+#endif
+
@@ -0,0 +1,147 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+#include "vararray.h"
+
+#include "p4thread.h"
+#include "p4connect.h"
+#include "clientusercollect.h"
+#include "parallelrun.h"
+
+struct RunJob
+{
+	StrBuf			cmd;
+	VarArray		args;
+	ClientUserCollect	output;
+};
+
+
+ParallelRun::ParallelRun( P4Settings *s, int n )
+{
+	settings = s;
+	nConnections = n > 0 ? n : 1;
+	next = 0;
+}
+
+ParallelRun::~ParallelRun()
+{
+	for ( int i = 0; i < jobs.Count(); i++ )
+	{
+	    RunJob *j = (RunJob *)jobs.Get( i );
+	    for ( int a = 0; a < j->args.Count(); a++ )
+		delete (StrBuf *)j->args.Get( a );
+	    delete j;
+	}
+}
+
+void
+ParallelRun::Add( const char *cmd, int argc, char **argv )
+{
+	RunJob *j = new RunJob;
+
+	j->cmd.Set( cmd );
+	for ( int i = 0; i < argc; i++ )
+	{
+	    StrBuf *a = new StrBuf;
+	    a->Set( argv[ i ] );
+	    j->args.Put( a );
+	}
+	jobs.Put( j );
+}
+
+ClientUserCollect *
+ParallelRun::Output( int job )
+{
+	return &((RunJob *)jobs.Get( job ))->output;
+}
+
+void
+ParallelRun::Run()
+{
+	int n = nConnections < jobs.Count() ? nConnections : jobs.Count();
+
+	next = 0;
+	P4RunThreads( n, Worker, this );
+
+	// Anything left over means no connection could be made at all.
+	for ( int i = next; i < jobs.Count(); i++ )
+	{
+	    if ( ! connectError.Test() )
+		connectError.Set( E_FAILED, "No connection to server." );
+	    Output( i )->HandleError( &connectError );
+	}
+}
+
+void
+ParallelRun::Worker( void *arg )
+{
+	ParallelRun	*self = (ParallelRun *)arg;
+	ClientApi	client;
+	Error		e;
+
+	// A connection that fails leaves its share of the work to the others
+	if ( ! self->settings->Connect( &client, &e ) )
+	{
+	    P4Lock	l( &self->lock );
+	    self->connectError = e;
+	    return;
+	}
+
+	for ( ;; )
+	{
+	    int	i;
+	    {
+		P4Lock	l( &self->lock );
+		i = self->next++;
+	    }
+
+	    if ( i >= self->jobs.Count() )
+		break;
+
+	    RunJob *j = (RunJob *)self->jobs.Get( i );
+
+	    if ( client.Dropped() )
+	    {
+		Error	lost;
+		lost.Set( E_FAILED, "Connection to server lost." );
+		j->output.HandleError( &lost );
+		continue;
+	    }
+
+	    char **argv = new char *[ j->args.Count() + 1 ];
+	    for ( int a = 0; a < j->args.Count(); a++ )
+		argv[ a ] = ((StrBuf *)j->args.Get( a ))->Text();
+
+	    client.SetArgv( j->args.Count(), argv );
+	    client.Run( j->cmd.Text(), &j->output );
+	    delete [] argv;
+	}
+
+	client.Final( &e );
+}
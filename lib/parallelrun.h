@@ -0,0 +1,64 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * ParallelRun - runs a list of commands over several connections at once.
+ *
+ * Each connection is opened with the same settings and runs on its own
+ * native thread, taking the next job from the list as soon as it's done
+ * with the last. The output of every job is collected separately so that
+ * it can be replayed to Perl in the order the jobs were added, however
+ * they actually finished.
+ */
+
+struct RunJob;
+
+class ParallelRun
+{
+    public:
+			ParallelRun( P4Settings *settings, int nConnections );
+			~ParallelRun();
+
+		void	Add( const char *cmd, int argc, char **argv );
+		void	Run();
+
+		int	Jobs()		{ return jobs.Count(); }
+		ClientUserCollect *Output( int job );
+
+    private:
+	static	void	Worker( void *self );
+
+    private:
+	P4Settings	*settings;
+	int		nConnections;
+	VarArray	jobs;
+	int		next;
+	P4Mutex		lock;
+	Error		connectError;
+};
+
@@ -0,0 +1,505 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+#include "vararray.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "p4thread.h"
+#include "p4connect.h"
+#include "clientusercollect.h"
+#include "parallelsync.h"
+
+/*
+ * Number of files synced by each Run() on a shard's connection. Progress
+ * is reported at this granularity.
+ */
+#define SYNC_BATCH	250
+
+struct SyncFile
+{
+	StrBuf	spec;
+	double	size;
+	int	index;
+};
+
+struct SyncShard
+{
+	SyncFile		**files;
+	int			count;
+	double			bytes;
+	ClientUserCollect	output;
+};
+
+static int
+CompareSize( const void *a, const void *b )
+{
+	const SyncFile *fa = *(const SyncFile **)a;
+	const SyncFile *fb = *(const SyncFile **)b;
+
+	if ( fa->size != fb->size )
+	    return fa->size > fb->size ? -1 : 1;
+	return fa->index - fb->index;
+}
+
+static int
+CompareIndex( const void *a, const void *b )
+{
+	return (*(const SyncFile **)a)->index - (*(const SyncFile **)b)->index;
+}
+
+
+ParallelSync::ParallelSync( P4Settings *s, int n )
+{
+	settings = s;
+	nShards = n > 0 ? n : 1;
+	files = 0;
+	nFiles = 0;
+	filesAlloc = 0;
+	totalBytes = 0;
+	threads = 0;
+	nThreads = 0;
+	nextShard = 0;
+	doneShards = 0;
+	doneFiles = 0;
+	doneBytes = 0;
+	listOnly = 0;
+	cancelled = 0;
+
+	shards = new SyncShard[ nShards ];
+	for ( int i = 0; i < nShards; i++ )
+	{
+	    shards[ i ].files = 0;
+	    shards[ i ].count = 0;
+	    shards[ i ].bytes = 0;
+	}
+}
+
+ParallelSync::~ParallelSync()
+{
+	Wait();
+
+	for ( int i = 0; i < nShards; i++ )
+	    free( shards[ i ].files );
+	delete [] shards;
+
+	for ( int j = 0; j < nFiles; j++ )
+	    delete files[ j ];
+	free( files );
+
+	for ( int k = 0; k < flags.Count(); k++ )
+	    delete (StrBuf *)flags.Get( k );
+}
+
+ClientUserCollect *
+ParallelSync::Output( int shard )
+{
+	return &shards[ shard ].output;
+}
+
+int
+ParallelSync::Errors()
+{
+	int n = listing.Errors();
+	for ( int i = 0; i < nShards; i++ )
+	    n += shards[ i ].output.Errors();
+	return n;
+}
+
+int
+ParallelSync::ShardFiles( int shard )
+{
+	return shards[ shard ].count;
+}
+
+const StrPtr *
+ParallelSync::ShardFile( int shard, int i )
+{
+	return &shards[ shard ].files[ i ]->spec;
+}
+
+double
+ParallelSync::ShardBytes( int shard )
+{
+	return shards[ shard ].bytes;
+}
+
+/*
+ * The number of a shard's files that its output says were synced.
+ */
+
+int
+ParallelSync::Synced( int shard, double &bytes )
+{
+	SyncShard *s = &shards[ shard ];
+	return Synced( s, 0, s->count, 0, bytes );
+}
+
+/*
+ * Ask the server what needs syncing. The flags are remembered for the
+ * real syncs; the file arguments are replaced by the explicit revisions
+ * the server gives us.
+ */
+
+void
+ParallelSync::List( int argc, char **argv )
+{
+	ClientApi	client;
+	Error		e;
+	char		**args = new char *[ argc + 1 ];
+	int		i;
+
+	args[ 0 ] = (char *)"-n";
+	for ( i = 0; i < argc && argv[ i ][ 0 ] == '-'; i++ )
+	{
+	    StrRef	flag( argv[ i ] );
+
+	    // -m limits the listing, not the shards
+	    if ( flag == "-m" )
+	    {
+		if ( i + 1 < argc ) i++;
+		continue;
+	    }
+
+	    if ( flag.Length() > 2 && flag.Text()[ 1 ] == 'm' )
+		continue;
+
+	    if ( flag == "-n" )
+		listOnly = 1;
+
+	    StrBuf *f = new StrBuf;
+	    f->Set( flag );
+	    flags.Put( f );
+	}
+
+	for ( i = 0; i < argc; i++ )
+	    args[ i + 1 ] = argv[ i ];
+
+	settings->Apply( &client );
+	client.SetProtocol( "tag", "" );
+	client.Init( &e );
+	if ( e.Test() )
+	{
+	    listing.HandleError( &e );
+	    delete [] args;
+	    return;
+	}
+
+	client.SetArgv( argc + 1, args );
+	client.Run( "sync", &listing );
+	client.Final( &e );
+	delete [] args;
+
+	Load();
+}
+
+/*
+ * Take the files from the records in the listing and share them out 
+ * between the shards.
+ */
+
+void
+ParallelSync::Load()
+{
+	for ( int i = 0; i < listing.Count(); i++ )
+	    if ( listing.Type( i ) == CT_STAT )
+		AddFile( listing.Dict( i ) );
+
+	Partition();
+}
+
+void
+ParallelSync::AddFile( StrDict *rec )
+{
+	StrPtr	*depotFile = rec->GetVar( "depotFile" );
+	StrPtr	*rev = rec->GetVar( "rev" );
+	StrPtr	*size = rec->GetVar( "fileSize" );
+
+	if ( ! depotFile || ! rev )
+	    return;
+
+	if ( nFiles == filesAlloc )
+	{
+	    filesAlloc = filesAlloc ? filesAlloc * 2 : 1024;
+	    files = (SyncFile **)realloc( files, 
+	    				filesAlloc * sizeof( SyncFile * ) );
+	}
+
+	SyncFile *f = new SyncFile;
+	f->spec << *depotFile << "#" << *rev;
+	f->index = nFiles;
+
+	// Older servers don't report the size. Deletes have none either,
+	// but still cost a round trip, so weight them all as one byte.
+	f->size = size ? atof( size->Text() ) : 0;
+	if ( f->size < 1 ) f->size = 1;
+
+	totalBytes += f->size;
+	files[ nFiles++ ] = f;
+}
+
+/*
+ * Greedy largest-first partition: each file goes to the shard with the
+ * fewest bytes so far. Each shard is then put back into depot order so
+ * the server walks its files in sequence.
+ */
+
+void
+ParallelSync::Partition()
+{
+	SyncFile	**bySize;
+	int		i, j;
+
+	if ( ! nFiles )
+	    return;
+
+	bySize = (SyncFile **)malloc( nFiles * sizeof( SyncFile * ) );
+	for ( i = 0; i < nFiles; i++ )
+	    bySize[ i ] = files[ i ];
+	qsort( bySize, nFiles, sizeof( SyncFile * ), CompareSize );
+
+	for ( i = 0; i < nShards; i++ )
+	    shards[ i ].files = (SyncFile **)malloc( nFiles * 
+	    					sizeof( SyncFile * ) );
+
+	for ( i = 0; i < nFiles; i++ )
+	{
+	    SyncShard *s = &shards[ 0 ];
+	    for ( j = 1; j < nShards; j++ )
+		if ( shards[ j ].bytes < s->bytes )
+		    s = &shards[ j ];
+
+	    s->files[ s->count++ ] = bySize[ i ];
+	    s->bytes += bySize[ i ]->size;
+	}
+
+	for ( i = 0; i < nShards; i++ )
+	    qsort( shards[ i ].files, shards[ i ].count, 
+	    		sizeof( SyncFile * ), CompareIndex );
+
+	free( bySize );
+}
+
+void
+ParallelSync::Start()
+{
+	if ( listOnly || ! nFiles )
+	    return;
+
+	threads = new P4Thread[ nShards ];
+	for ( nThreads = 0; nThreads < nShards; nThreads++ )
+	    if ( ! threads[ nThreads ].Start( Worker, this ) )
+		break;
+
+	// No threads at all? Do it the slow way.
+	if ( ! nThreads )
+	    Worker( this );
+}
+
+/*
+ * Report progress so far. Returns true once every shard has finished.
+ */
+
+int
+ParallelSync::Poll( int &f, double &b )
+{
+	P4Lock	l( &lock );
+
+	f = doneFiles;
+	b = doneBytes;
+	return ! threads || doneShards == nShards;
+}
+
+void
+ParallelSync::Cancel()
+{
+	P4Lock	l( &lock );
+	cancelled = 1;
+}
+
+void
+ParallelSync::Wait()
+{
+	if ( ! threads )
+	    return;
+
+	for ( int i = 0; i < nThreads; i++ )
+	    threads[ i ].Join();
+
+	delete [] threads;
+	threads = 0;
+}
+
+void
+ParallelSync::Worker( void *arg )
+{
+	ParallelSync	*self = (ParallelSync *)arg;
+
+	for ( ;; )
+	{
+	    int	i;
+	    {
+		P4Lock	l( &self->lock );
+		i = self->nextShard++;
+	    }
+
+	    if ( i >= self->nShards )
+		break;
+
+	    self->RunShard( &self->shards[ i ] );
+
+	    P4Lock	l( &self->lock );
+	    self->doneShards++;
+	}
+}
+
+/*
+ * Count the files of a batch that were actually synced, from the output
+ * it added to the shard after event from. Each file synced is reported
+ * as a record with its depotFile, or in untagged mode as a line of info
+ * starting "//depot/path#rev". Errors and warnings don't count.
+ */
+
+int
+ParallelSync::Synced( SyncShard *s, int first, int n, int from, 
+		      double &bytes )
+{
+	char	*done = new char[ n ];
+	int	count = 0;
+
+	memset( done, 0, n );
+	bytes = 0;
+
+	for ( int i = from; i < s->output.Count(); i++ )
+	{
+	    StrRef	path;
+
+	    if ( s->output.Type( i ) == CT_STAT )
+	    {
+		StrPtr *d = s->output.Dict( i )->GetVar( "depotFile" );
+		if ( ! d )
+		    continue;
+		path.Set( d->Text(), d->Length() );
+	    }
+	    else if ( s->output.Type( i ) == CT_INFO )
+	    {
+		const StrPtr *t = s->output.Text( i );
+		const char *h = strchr( t->Text(), '#' );
+		if ( ! h )
+		    continue;
+		path.Set( t->Text(), h - t->Text() );
+	    }
+	    else
+		continue;
+
+	    for ( int j = 0; j < n; j++ )
+	    {
+		SyncFile *f = s->files[ first + j ];
+
+		if ( ! done[ j ] && f->spec.Length() > path.Length() &&
+		     f->spec[ path.Length() ] == '#' &&
+		     ! memcmp( f->spec.Text(), path.Text(), path.Length() ) )
+		{
+		    done[ j ] = 1;
+		    count++;
+		    bytes += f->size;
+		    break;
+		}
+	    }
+	}
+
+	delete [] done;
+	return count;
+}
+
+void
+ParallelSync::RunShard( SyncShard *s )
+{
+	ClientApi	client;
+	Error		e;
+	int		nFlags = flags.Count();
+	char		**args;
+
+	if ( ! s->count )
+	    return;
+
+	if ( ! settings->Connect( &client, &e ) )
+	{
+	    s->output.HandleError( &e );
+	    return;
+	}
+
+	args = new char *[ nFlags + SYNC_BATCH ];
+	for ( int i = 0; i < nFlags; i++ )
+	    args[ i ] = ((StrBuf *)flags.Get( i ))->Text();
+
+	int first = 0;
+
+	while ( first < s->count )
+	{
+	    int		n = 0;
+	    int		from = s->output.Count();
+	    int		ok;
+	    double	bytes = 0;
+
+	    if ( client.Dropped() )
+	    {
+		Error	lost;
+		lost.Set( E_FAILED, "Connection to server lost. "
+				    "%count% file(s) not synced." ) 
+		    << s->count - first;
+		s->output.HandleError( &lost );
+		break;
+	    }
+
+	    {
+		P4Lock	l( &lock );
+		if ( cancelled )
+		    break;
+	    }
+
+	    for ( ; n < SYNC_BATCH && first + n < s->count; n++ )
+		args[ nFlags + n ] = s->files[ first + n ]->spec.Text();
+
+	    client.SetArgv( nFlags + n, args );
+	    client.Run( "sync", &s->output );
+	    ok = Synced( s, first, n, from, bytes );
+	    first += n;
+
+	    P4Lock	l( &lock );
+	    doneFiles += ok;
+	    doneBytes += bytes;
+	}
+
+	delete [] args;
+	client.Final( &e );
+	if ( e.Test() )
+	    s->output.HandleError( &e );
+}
@@ -0,0 +1,105 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * ParallelSync - populates a workspace over several connections at once.
+ *
+ * The list of files to be synced is fetched with "p4 sync -n" and split
+ * into shards of roughly equal size (largest files first, each going to
+ * the lightest shard). Each shard is then synced by its own ClientApi on
+ * its own native thread, so the local disk writes of one connection
+ * overlap the network reads of the others.
+ *
+ * The worker threads never call Perl. Their output is collected and can
+ * be replayed to a ClientUserPerl object once Wait() has returned, and
+ * Poll() gives the calling thread a count of the files actually synced
+ * while they run. Cancel() stops them after their current batch.
+ */
+
+struct SyncFile;
+struct SyncShard;
+
+class ParallelSync
+{
+    public:
+			ParallelSync( P4Settings *settings, int nShards );
+			~ParallelSync();
+
+		void	List( int argc, char **argv );
+		void	Load();
+		void	Start();
+		int	Poll( int &files, double &bytes );
+		void	Cancel();
+		void	Wait();
+
+		ClientUserCollect *Listing()	{ return &listing; }
+		ClientUserCollect *Output( int shard );
+		int	Shards()		{ return nShards; }
+
+		int	TotalFiles()		{ return nFiles; }
+		double	TotalBytes()		{ return totalBytes; }
+		int	Errors();
+
+		// How the files were shared out, and what each shard synced
+		int	ShardFiles( int shard );
+	const StrPtr	*ShardFile( int shard, int i );
+		double	ShardBytes( int shard );
+		int	Synced( int shard, double &bytes );
+
+    private:
+	static	void	Worker( void *self );
+		void	RunShard( SyncShard *s );
+		void	Partition();
+		void	AddFile( StrDict *rec );
+		int	Synced( SyncShard *s, int first, int n, int from,
+				double &bytes );
+
+    private:
+	P4Settings	*settings;
+	ClientUserCollect listing;
+	VarArray	flags;
+
+	SyncFile	**files;
+	int		nFiles;
+	int		filesAlloc;
+	double		totalBytes;
+
+	SyncShard	*shards;
+	int		nShards;
+	P4Thread	*threads;
+	int		nThreads;
+
+	P4Mutex		lock;
+	int		nextShard;
+	int		doneShards;
+	int		doneFiles;
+	double		doneBytes;
+	int		listOnly;
+	int		cancelled;
+};
+
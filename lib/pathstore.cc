@@ -0,0 +1,215 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "strhash.h"
+#include "pathstore.h"
+
+#define IS_SEP( c )	( (c) == '/' || (c) == '\\' )
+
+PathStore::PathStore()
+{
+	dirHash = new StrHash;
+	dirs = 0;
+	nDirs = 0;
+	dirsAlloc = 0;
+	paths = 0;
+	nPaths = 0;
+	pathsAlloc = 0;
+}
+
+PathStore::~PathStore()
+{
+	delete dirHash;
+	free( dirs );
+	free( paths );
+}
+
+void
+PathStore::Clear()
+{
+	dirHash->Clear();
+	nDirs = 0;
+	nPaths = 0;
+	names.Clear();
+}
+
+/*
+ * Finds the directory called name (including its separator) in the 
+ * directory parent, or -1 for the root. If it's not there and add is
+ * set, it's created. Returns the id of the directory, or -1.
+ */
+int
+PathStore::Dir( int parent, const char *name, int len, int add )
+{
+	void	*v;
+
+	// Keyed on the parent id followed by the name
+	key.Clear();
+	key.Append( (const char *)&parent, sizeof( parent ) );
+	key.Append( name, len );
+
+	if ( ( v = dirHash->Find( key ) ) )
+	    return (int)(size_t)v - 1;
+
+	if ( ! add )
+	    return -1;
+
+	if ( nDirs == dirsAlloc )
+	{
+	    dirsAlloc = dirsAlloc ? dirsAlloc * 2 : 1024;
+	    dirs = (int *)realloc( dirs, dirsAlloc * 3 * sizeof( int ) );
+	}
+
+	int	*d = dirs + nDirs * 3;
+	d[ 0 ] = parent;
+	d[ 1 ] = names.Length();
+	d[ 2 ] = len;
+	names.Append( name, len );
+
+	// Store id + 1 so that the first directory isn't a null pointer
+	dirHash->Insert( key, (void *)(size_t)( nDirs + 1 ) );
+	return nDirs++;
+}
+
+/*
+ * Adds a path and returns its id. Adding the same path twice stores 
+ * it twice, but its directories only once.
+ */
+int
+PathStore::Add( const StrPtr &path )
+{
+	const char	*p = path.Text();
+	const char	*end = p + path.Length();
+	const char	*s;
+	int		dir = -1;
+
+	for ( s = p; p < end; p++ )
+	{
+	    if ( IS_SEP( *p ) )
+	    {
+		dir = Dir( dir, s, p - s + 1, 1 );
+		s = p + 1;
+	    }
+	}
+
+	if ( nPaths == pathsAlloc )
+	{
+	    pathsAlloc = pathsAlloc ? pathsAlloc * 2 : 1024;
+	    paths = (int *)realloc( paths, pathsAlloc * 3 * sizeof( int ) );
+	}
+
+	int	*f = paths + nPaths * 3;
+	f[ 0 ] = dir;
+	f[ 1 ] = names.Length();
+	f[ 2 ] = end - s;
+	names.Append( s, end - s );
+
+	return nPaths++;
+}
+
+void
+PathStore::Get( int id, StrBuf &path )
+{
+	int	*f = paths + id * 3;
+	int	len = f[ 2 ];
+	int	d;
+	char	*p;
+
+	for ( d = f[ 0 ]; d >= 0; d = dirs[ d * 3 ] )
+	    len += dirs[ d * 3 + 2 ];
+
+	// Fill it in from the end, working up the directories
+	path.Clear();
+	p = path.Alloc( len ) + len;
+
+	p -= f[ 2 ];
+	memcpy( p, names.Text() + f[ 1 ], f[ 2 ] );
+
+	for ( d = f[ 0 ]; d >= 0; d = dirs[ d * 3 ] )
+	{
+	    p -= dirs[ d * 3 + 2 ];
+	    memcpy( p, names.Text() + dirs[ d * 3 + 1 ], dirs[ d * 3 + 2 ] );
+	}
+	path.Terminate();
+}
+
+/*
+ * Returns the id of the directory named by prefix, with or without a
+ * trailing separator, or -1 if no path we hold is in it.
+ */
+int
+PathStore::FindDir( const StrPtr &prefix )
+{
+	const char	*p = prefix.Text();
+	const char	*end = p + prefix.Length();
+	const char	*s;
+	int		dir = -1;
+
+	for ( s = p; p < end; p++ )
+	{
+	    if ( IS_SEP( *p ) )
+	    {
+		if ( ( dir = Dir( dir, s, p - s + 1, 0 ) ) < 0 )
+		    return -1;
+		s = p + 1;
+	    }
+	}
+
+	if ( s == end )
+	    return dir;
+
+	// No trailing separator: try both
+	StrBuf	last;
+	int	d;
+
+	last.Set( s, end - s );
+	last.Append( "/" );
+	if ( ( d = Dir( dir, last.Text(), last.Length(), 0 ) ) >= 0 )
+	    return d;
+
+	last.Set( s, end - s );
+	last.Append( "\\" );
+	return Dir( dir, last.Text(), last.Length(), 0 );
+}
+
+/*
+ * Is path id somewhere beneath the directory dir?
+ */
+int
+PathStore::Under( int id, int dir )
+{
+	for ( int d = paths[ id * 3 ]; d >= 0; d = dirs[ d * 3 ] )
+	    if ( d == dir )
+		return 1;
+	return 0;
+}
@@ -0,0 +1,76 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * PathStore - a compact store for large numbers of file paths.
+ *
+ * Paths are split into directories and a file name. Each distinct 
+ * directory is stored once, as its own name plus a reference to its
+ * parent, so the long common prefixes of depot and client paths cost
+ * almost nothing. A path is just its directory and the offset of its
+ * file name, and the full string is only rebuilt when it's asked for.
+ *
+ * Directory names keep their trailing separator ("/" or "\"), so paths
+ * come back exactly as they went in.
+ */
+
+class StrHash;
+
+class PathStore
+{
+    public:
+			PathStore();
+			~PathStore();
+
+		int	Add( const StrPtr &path );
+		void	Get( int id, StrBuf &path );
+		void	Clear();
+
+		int	Count()		{ return nPaths; }
+		int	Dirs()		{ return nDirs; }
+
+		// Prefix queries
+		int	FindDir( const StrPtr &prefix );
+		int	Under( int id, int dir );
+
+    private:
+		int	Dir( int parent, const char *name, int len, int add );
+
+    private:
+	StrHash		*dirHash;
+	int		*dirs;		// parent, name offset, name length
+	int		nDirs;
+	int		dirsAlloc;
+
+	int		*paths;		// dir, name offset, name length
+	int		nPaths;
+	int		pathsAlloc;
+
+	StrBuf		names;
+	StrBuf		key;
+};
@@ -0,0 +1,210 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strhash.h"
+#include "pathstore.h"
+#include "resultstore.h"
+
+/*
+ * Absolute depot, client and local paths. Anything else is kept as is.
+ */
+static int
+IsPath( const StrPtr &val )
+{
+	const char *p = val.Text();
+
+	if ( p[ 0 ] == '/' )
+	    return 1;
+
+	return val.Length() > 2 && isalpha( p[ 0 ] ) && p[ 1 ] == ':' &&
+	       ( p[ 2 ] == '/' || p[ 2 ] == '\\' );
+}
+
+ResultStore::ResultStore()
+{
+	names = new StrHash;
+	paths = new PathStore;
+	fields = 0;
+	nFields = 0;
+	fieldsAlloc = 0;
+	records = 0;
+	nRecords = 0;
+	recordsAlloc = 0;
+}
+
+ResultStore::~ResultStore()
+{
+	delete names;
+	delete paths;
+	free( fields );
+	free( records );
+}
+
+void
+ResultStore::Clear()
+{
+	names->Clear();
+	paths->Clear();
+	values.Clear();
+	nFields = 0;
+	nRecords = 0;
+}
+
+int
+ResultStore::Name( const StrPtr &name )
+{
+	void	*v;
+
+	if ( ( v = names->Find( name ) ) )
+	    return (int)(size_t)v - 1;
+
+	names->Insert( name, (void *)(size_t)( names->Count() + 1 ) );
+	return names->Count() - 1;
+}
+
+/*
+ * Returns the record number
+ */
+int
+ResultStore::Add( StrDict *d )
+{
+	StrRef	var, val;
+
+	// records[ n ] is where record n starts, and records[ n + 1 ] 
+	// where it ends
+	if ( nRecords + 2 > recordsAlloc )
+	{
+	    recordsAlloc = recordsAlloc ? recordsAlloc * 2 : 1024;
+	    records = (int *)realloc( records, recordsAlloc * sizeof( int ) );
+	    records[ 0 ] = 0;
+	}
+
+	for ( int i = 0; d->GetVar( i, var, val ); i++ )
+	{
+	    if ( nFields == fieldsAlloc )
+	    {
+		fieldsAlloc = fieldsAlloc ? fieldsAlloc * 2 : 4096;
+		fields = (int *)realloc( fields, 
+					 fieldsAlloc * 3 * sizeof( int ) );
+	    }
+
+	    int	*f = fields + nFields++ * 3;
+	    f[ 0 ] = Name( var );
+
+	    if ( IsPath( val ) )
+	    {
+		f[ 1 ] = paths->Add( val );
+		f[ 2 ] = -1;
+	    }
+	    else
+	    {
+		f[ 1 ] = values.Length();
+		f[ 2 ] = val.Length();
+		values.Append( val.Text(), val.Length() );
+	    }
+	}
+
+	records[ ++nRecords ] = nFields;
+	return nRecords - 1;
+}
+
+/*
+ * Gets the x'th variable of record rec, returning 0 if there isn't one.
+ */
+int
+ResultStore::GetVar( int rec, int x, StrRef &var, StrBuf &val )
+{
+	if ( rec < 0 || rec >= nRecords || x < 0 ||
+	     records[ rec ] + x >= records[ rec + 1 ] )
+	    return 0;
+
+	int	*f = fields + ( records[ rec ] + x ) * 3;
+
+	var.Set( *names->Key( f[ 0 ] ) );
+	if ( f[ 2 ] < 0 )
+	    paths->Get( f[ 1 ], val );
+	else
+	    val.Set( values.Text() + f[ 1 ], f[ 2 ] );
+	return 1;
+}
+
+/*
+ * Returns the index into fields of variable var in record rec, or -1.
+ */
+int
+ResultStore::Field( int rec, const StrPtr &var )
+{
+	void	*v;
+	int	n;
+
+	if ( rec < 0 || rec >= nRecords || ! ( v = names->Find( var ) ) )
+	    return -1;
+
+	n = (int)(size_t)v - 1;
+	for ( int i = records[ rec ]; i < records[ rec + 1 ]; i++ )
+	    if ( fields[ i * 3 ] == n )
+		return i;
+	return -1;
+}
+
+int
+ResultStore::GetVar( int rec, const StrPtr &var, StrBuf &val )
+{
+	StrRef	name;
+	int	i = Field( rec, var );
+
+	return i >= 0 && GetVar( rec, i - records[ rec ], name, val );
+}
+
+/*
+ * Rebuilds record rec into d, which should be empty.
+ */
+void
+ResultStore::Dict( int rec, StrDict *d )
+{
+	StrRef	var;
+	StrBuf	val;
+
+	for ( int i = 0; GetVar( rec, i, var, val ); i++ )
+	    d->SetVar( var, val );
+}
+
+int
+ResultStore::Under( int rec, const StrPtr &var, int dir )
+{
+	int	i = Field( rec, var );
+
+	return i >= 0 && fields[ i * 3 + 2 ] < 0 && 
+	       paths->Under( fields[ i * 3 + 1 ], dir );
+}
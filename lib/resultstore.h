@@ -0,0 +1,74 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * ResultStore - holds the tagged output of a command compactly. Each 
+ * variable name is stored once, values which look like paths go in a 
+ * PathStore, and everything else is packed into a single buffer. The
+ * StrDict for a record is only rebuilt when it's asked for.
+ */
+
+class StrHash;
+class PathStore;
+
+class ResultStore
+{
+    public:
+			ResultStore();
+			~ResultStore();
+
+		int	Add( StrDict *d );
+		void	Clear();
+
+		int	Count()		{ return nRecords; }
+		int	GetVar( int rec, int x, StrRef &var, StrBuf &val );
+		int	GetVar( int rec, const StrPtr &var, StrBuf &val );
+		void	Dict( int rec, StrDict *d );
+
+		// Is the value of var in record rec a path beneath the 
+		// directory dir of Paths()?
+		int	Under( int rec, const StrPtr &var, int dir );
+	PathStore	*Paths()	{ return paths; }
+
+    private:
+		int	Name( const StrPtr &name );
+		int	Field( int rec, const StrPtr &var );
+
+    private:
+	StrHash		*names;
+	PathStore	*paths;
+	StrBuf		values;
+
+	int		*fields;	// name id, value offset or path id,
+	int		nFields;	// value length (-1 for paths)
+	int		fieldsAlloc;
+
+	int		*records;	// first field of each record
+	int		nRecords;
+	int		recordsAlloc;
+};
@@ -0,0 +1,115 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+
+#include <string.h>
+
+#include "statrecord.h"
+
+/*
+ * The offset table and the text of all the variables and values share
+ * one buffer, the table first. Each string is null terminated.
+ */
+
+StatRecord::StatRecord( StrDict *dict )
+{
+	StrRef	var, val;
+	int	size = 0;
+	int	i;
+
+	utf8 = 0;
+
+	for ( count = 0; dict->GetVar( count, var, val ); count++ )
+	    size += var.Length() + val.Length() + 2;
+
+	buf = new char[ count * 4 * sizeof( int ) + size ];
+	table = (int *)buf;
+
+	char	*p = buf + count * 4 * sizeof( int );
+
+	for ( i = 0; i < count && dict->GetVar( i, var, val ); i++ )
+	{
+	    int	*t = table + i * 4;
+
+	    t[ 0 ] = p - buf;
+	    t[ 1 ] = var.Length();
+	    memcpy( p, var.Text(), var.Length() );
+	    p += var.Length();
+	    *p++ = 0;
+
+	    t[ 2 ] = p - buf;
+	    t[ 3 ] = val.Length();
+	    memcpy( p, val.Text(), val.Length() );
+	    p += val.Length();
+	    *p++ = 0;
+	}
+	count = i;
+}
+
+StatRecord::~StatRecord()
+{
+	delete [] buf;
+}
+
+StrPtr *
+StatRecord::VGetVar( const StrPtr &var )
+{
+	for ( int i = 0; i < count; i++ )
+	{
+	    int	*t = table + i * 4;
+
+	    if ( t[ 1 ] == (int)var.Length() &&
+		 ! memcmp( buf + t[ 0 ], var.Text(), t[ 1 ] ) )
+	    {
+		found.Set( buf + t[ 2 ], t[ 3 ] );
+		return &found;
+	    }
+	}
+	return 0;
+}
+
+/*
+ * Records are read-only.
+ */
+void
+StatRecord::VSetVar( const StrPtr &var, const StrPtr &val )
+{
+}
+
+int
+StatRecord::VGetVarX( int x, StrRef &var, StrRef &val )
+{
+	if ( x < 0 || x >= count )
+	    return 0;
+
+	int	*t = table + x * 4;
+	var.Set( buf + t[ 0 ], t[ 1 ] );
+	val.Set( buf + t[ 2 ], t[ 3 ] );
+	return 1;
+}
@@ -0,0 +1,60 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * StatRecord - a read-only copy of the variables of a StrDict, kept in 
+ * a single allocation. Used to hand tagged output to Perl as a 
+ * P4::Client::Record object whose fields are only converted into Perl
+ * data when they're asked for.
+ */
+
+class StatRecord : public StrDict
+{
+    public:
+			StatRecord( StrDict *dict );
+			~StatRecord();
+
+		int	Count()		{ return count; }
+
+		// The Utf8Policy to use when handing it to Perl
+		void	SetUtf8( int m )	{ utf8 = m; }
+		int	Utf8()		{ return utf8; }
+
+    protected:
+		StrPtr	*VGetVar( const StrPtr &var );
+		void	VSetVar( const StrPtr &var, const StrPtr &val );
+		int	VGetVarX( int x, StrRef &var, StrRef &val );
+
+    private:
+	int		count;
+	int		*table;		// var offset, var length, 
+					// value offset, value length
+	char		*buf;
+	StrRef		found;
+	int		utf8;
+};
@@ -0,0 +1,176 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "strhash.h"
+
+struct StrHashNode
+{
+	StrBuf		key;
+	void		*value;
+	unsigned int	hash;
+	StrHashNode	*next;
+};
+
+/*
+ * FNV-1a. Cheap, and good enough for path names.
+ */
+static unsigned int
+HashString( const char *p, int len )
+{
+	unsigned int h = 2166136261U;
+	while ( len-- )
+	{
+	    h ^= (unsigned char)*p++;
+	    h *= 16777619U;
+	}
+	return h;
+}
+
+
+StrHash::StrHash()
+{
+	nBuckets = 1024;
+	buckets = (StrHashNode **)calloc( nBuckets, sizeof( StrHashNode * ) );
+	order = 0;
+	count = 0;
+	alloc = 0;
+}
+
+StrHash::~StrHash()
+{
+	Clear();
+	free( buckets );
+}
+
+void
+StrHash::Clear()
+{
+	for ( int i = 0; i < count; i++ )
+	    delete order[ i ];
+	free( order );
+	order = 0;
+	count = 0;
+	alloc = 0;
+	memset( buckets, 0, nBuckets * sizeof( StrHashNode * ) );
+}
+
+StrHashNode *
+StrHash::Lookup( const char *key, int len, unsigned int h )
+{
+	StrHashNode *n = buckets[ h & ( nBuckets - 1 ) ];
+
+	for ( ; n; n = n->next )
+	    if ( n->hash == h && (int)n->key.Length() == len && 
+		    !memcmp( n->key.Text(), key, len ) )
+		return n;
+
+	return 0;
+}
+
+void *
+StrHash::Find( const char *key, int len )
+{
+	StrHashNode *n = Lookup( key, len, HashString( key, len ) );
+	return n ? n->value : 0;
+}
+
+void *
+StrHash::Find( const StrPtr &key )
+{
+	return Find( key.Text(), key.Length() );
+}
+
+int
+StrHash::Contains( const StrPtr &key )
+{
+	return Lookup( key.Text(), key.Length(), 
+		       HashString( key.Text(), key.Length() ) ) != 0;
+}
+
+void
+StrHash::Insert( const StrPtr &key, void *value )
+{
+	unsigned int	h = HashString( key.Text(), key.Length() );
+	StrHashNode	*n = Lookup( key.Text(), key.Length(), h );
+
+	if ( n )
+	{
+	    n->value = value;
+	    return;
+	}
+
+	if ( count >= nBuckets )
+	    Grow();
+
+	if ( count == alloc )
+	{
+	    alloc = alloc ? alloc * 2 : 1024;
+	    order = (StrHashNode **)realloc( order, 
+	    				alloc * sizeof( StrHashNode * ) );
+	}
+
+	n = new StrHashNode;
+	n->key.Set( key );
+	n->value = value;
+	n->hash = h;
+	n->next = buckets[ h & ( nBuckets - 1 ) ];
+	buckets[ h & ( nBuckets - 1 ) ] = n;
+	order[ count++ ] = n;
+}
+
+void
+StrHash::Grow()
+{
+	free( buckets );
+	nBuckets *= 2;
+	buckets = (StrHashNode **)calloc( nBuckets, sizeof( StrHashNode * ) );
+
+	for ( int i = 0; i < count; i++ )
+	{
+	    StrHashNode *n = order[ i ];
+	    n->next = buckets[ n->hash & ( nBuckets - 1 ) ];
+	    buckets[ n->hash & ( nBuckets - 1 ) ] = n;
+	}
+}
+
+const StrPtr *
+StrHash::Key( int i )
+{
+	return &order[ i ]->key;
+}
+
+void *
+StrHash::Value( int i )
+{
+	return order[ i ]->value;
+}
@@ -0,0 +1,66 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * StrHash - a simple chained hash table mapping strings to pointers.
+ * The table doesn't own the values. Entries are never removed, and can be
+ * walked in the order in which they were inserted using Count(), Key()
+ * and Value(). Find() returns 0 for a missing key, so use Contains() when
+ * the stored values may themselves be null.
+ */
+
+struct StrHashNode;
+
+class StrHash
+{
+    public:
+			StrHash();
+			~StrHash();
+
+		void	*Find( const StrPtr &key );
+		void	*Find( const char *key, int len );
+		int	Contains( const StrPtr &key );
+		void	Insert( const StrPtr &key, void *value );
+		void	Clear();
+
+		int	Count()		{ return count; }
+	const StrPtr	*Key( int i );
+		void	*Value( int i );
+
+    private:
+		StrHashNode *Lookup( const char *key, int len, unsigned int h );
+		void	Grow();
+
+    private:
+	StrHashNode	**buckets;
+	StrHashNode	**order;
+	int		nBuckets;
+	int		count;
+	int		alloc;
+};
+
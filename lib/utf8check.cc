@@ -0,0 +1,218 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "clientapi.h"
+
+#include <string.h>
+
+#include "utf8check.h"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || \
+    ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+# define UTF8_SSE2
+# include <emmintrin.h>
+#endif
+
+/*
+ * Returns the length of the leading run of 7-bit bytes in p.
+ */
+
+int
+Utf8Check::Ascii( const char *p, int len )
+{
+	int	i = 0;
+
+#ifdef UTF8_SSE2
+	// The top bit of each byte is all movemask looks at.
+	for ( ; i + 16 <= len; i += 16 )
+	{
+	    __m128i v = _mm_loadu_si128( (const __m128i *)( p + i ) );
+	    int	    m = _mm_movemask_epi8( v );
+
+	    if ( m )
+	    {
+		while ( !( m & 1 ) )
+		    m >>= 1, i++;
+		return i;
+	    }
+	}
+#else
+	for ( ; i + 8 <= len; i += 8 )
+	{
+	    unsigned int w[ 2 ];
+
+	    memcpy( w, p + i, 8 );
+	    if ( ( w[ 0 ] | w[ 1 ] ) & 0x80808080 )
+		break;
+	}
+#endif
+
+	while ( i < len && !( p[ i ] & 0x80 ) )
+	    i++;
+
+	return i;
+}
+
+/*
+ * Decodes the sequence starting at p, which has avail bytes left after 
+ * it. Returns the length of a valid sequence, 0 if it's invalid, or 
+ * minus the number of bytes available if they're a valid start to a 
+ * sequence that runs off the end. Follows table 3-7 of the Unicode 
+ * standard, so overlong forms, surrogates and anything above U+10FFFF
+ * are all invalid.
+ */
+
+int
+Utf8Check::Sequence( const unsigned char *p, int avail )
+{
+	unsigned char	lo = 0x80, hi = 0xBF;
+	int		n;
+
+	if ( p[ 0 ] < 0x80 )
+	    return 1;
+	else if ( p[ 0 ] < 0xC2 )
+	    return 0;
+	else if ( p[ 0 ] < 0xE0 )
+	    n = 2;
+	else if ( p[ 0 ] < 0xF0 )
+	{
+	    n = 3;
+	    if ( p[ 0 ] == 0xE0 ) lo = 0xA0;
+	    if ( p[ 0 ] == 0xED ) hi = 0x9F;
+	}
+	else if ( p[ 0 ] < 0xF5 )
+	{
+	    n = 4;
+	    if ( p[ 0 ] == 0xF0 ) lo = 0x90;
+	    if ( p[ 0 ] == 0xF4 ) hi = 0x8F;
+	}
+	else
+	    return 0;
+
+	// Only the second byte has a restricted range
+	for ( int i = 1; i < n; i++ )
+	{
+	    if ( i == avail )
+		return -avail;
+	    if ( p[ i ] < lo || p[ i ] > hi )
+		return 0;
+	    lo = 0x80;
+	    hi = 0xBF;
+	}
+
+	return n;
+}
+
+/*
+ * Check the string p. If tail is given, a sequence which is cut short 
+ * by the end of the string isn't counted as invalid: its length is 
+ * returned in tail instead, so that a caller receiving text in chunks 
+ * can hold it back until the rest arrives.
+ */
+
+int
+Utf8Check::Scan( const char *p, int len, int *tail )
+{
+	const unsigned char *u = (const unsigned char *)p;
+	int	status = UTF8_ASCII;
+	int	i = 0;
+	int	n;
+
+	if ( tail )
+	    *tail = 0;
+
+	for ( ;; )
+	{
+	    i += Ascii( p + i, len - i );
+	    if ( i == len )
+		return status;
+
+	    // Decode multibyte sequences until we're back in ASCII
+	    while ( i < len && ( u[ i ] & 0x80 ) )
+	    {
+		n = Sequence( u + i, len - i );
+
+		if ( n < 0 && tail )
+		{
+		    *tail = -n;
+		    return status;
+		}
+		if ( n <= 0 )
+		    return UTF8_INVALID;
+
+		i += n;
+		status = UTF8_VALID;
+	    }
+	}
+}
+
+/*
+ * Copy p to out as valid UTF-8, converting each byte that doesn't start
+ * a valid sequence according to policy.
+ */
+
+void
+Utf8Check::Repair( const char *p, int len, StrBuf &out, int policy )
+{
+	const unsigned char *u = (const unsigned char *)p;
+	int	i = 0;
+	int	n;
+
+	out.Clear();
+
+	while ( i < len )
+	{
+	    n = Ascii( p + i, len - i );
+	    if ( n )
+	    {
+		out.Append( p + i, n );
+		i += n;
+		continue;
+	    }
+
+	    if ( ( n = Sequence( u + i, len - i ) ) > 0 )
+	    {
+		out.Append( p + i, n );
+		i += n;
+		continue;
+	    }
+
+	    if ( policy == UTF8_LATIN1 )
+	    {
+		out.Extend( (char)( 0xC0 | ( u[ i ] >> 6 ) ) );
+		out.Extend( (char)( 0x80 | ( u[ i ] & 0x3F ) ) );
+	    }
+	    else
+	    {
+		out.Append( "\xEF\xBF\xBD", 3 );
+	    }
+	    i++;
+	}
+
+	out.Terminate();
+}
@@ -0,0 +1,64 @@
+/*
+
+Copyright (c) 1997-2004, Perforce Software, Inc.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL PERFORCE SOFTWARE, INC. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+/*
+ * Utf8Check - validation of the text we get from unicode servers, so 
+ * that it can be handed to Perl already flagged as UTF-8.
+ *
+ * Most of what the server sends is plain ASCII, so Scan() skips over
+ * ASCII a block at a time (with SSE2 where the compiler has it) and only
+ * decodes the bytes around any multibyte sequences it finds. Strings 
+ * which aren't valid UTF-8 are dealt with according to a Utf8Policy.
+ */
+
+enum Utf8Policy
+{
+	UTF8_OFF,		// Don't check or flag anything
+	UTF8_BYTES,		// Pass invalid strings on as plain bytes
+	UTF8_REPLACE,		// Replace invalid bytes with U+FFFD
+	UTF8_LATIN1		// Treat invalid bytes as ISO-8859-1
+};
+
+enum Utf8Status
+{
+	UTF8_ASCII,		// Valid, and all 7-bit
+	UTF8_VALID,		// Valid, with multibyte sequences
+	UTF8_INVALID
+};
+
+class Utf8Check
+{
+    public:
+	static	int	Ascii( const char *p, int len );
+	static	int	Scan( const char *p, int len, int *tail = 0 );
+	static	void	Repair( const char *p, int len, StrBuf &out, 
+				int policy );
+
+    private:
+	static	int	Sequence( const unsigned char *p, int avail );
+};